@@ -8,6 +8,14 @@
 
 using namespace std;
 
+extern bool readLocalPartition(const char* inputFile, vector<int>& local_data, int& total_n, int rank, int size, MPI_Comm comm);
+extern vector<int> gatherPrefix(const vector<int>& local_data, int total_n, int count, int rank, int size, MPI_Comm comm);
+extern bool writeDistributedArray(const char* outputFile, const int* data, int local_n, const char* label, bool append, int rank, int size, MPI_Comm comm);
+extern bool isBinaryOutput(const char* outputFile);
+extern void rebalancePartition(vector<int>& local_data, int total_n, int rank, int size, MPI_Comm comm);
+extern long long blockOffset(int total, int size, int r);
+extern void localSort(int* data, int n);
+
 // Function to compare and swap elements locally based on direction
 void compareAndSwap(vector<int>& arr, int i, int j, bool dir) {
     if (dir == (arr[i] > arr[j])) {
@@ -15,137 +23,387 @@ void compareAndSwap(vector<int>& arr, int i, int j, bool dir) {
     }
 }
 
-// Function for bitonic merge - performs the compare-split operation
-// on local data after receiving from partner
-void bitonicMerge(vector<int>& local_data, vector<int>& recv_data, bool dir) {
-    int n = local_data.size();
-    
-    // Perform compare-split operation directly on local_data and recv_data
-    for (int i = 0; i < n; i++) {
-        // If local_data[i] and recv_data[i] are out of order according to dir, swap them
-        if (dir == (local_data[i] > recv_data[i])) {
-            swap(local_data[i], recv_data[i]);
+// Local sort: a SIMD bitonic sorting network forms short sorted runs, which
+// are then merged with a SIMD bitonic merge. The AVX-512 or AVX2 kernel is
+// picked at runtime; other CPUs use localSort (Local_Sort.cpp).
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BITONIC_SIMD 1
+// The kernels are built from small helpers that must be inlined even in
+// unoptimized builds
+#define SIMD_INLINE inline __attribute__((always_inline))
+#endif
+
+// Lanes that take the maximum in the compare-exchange step (k, j) of a
+// bitonic sorting network over width lanes: lane i is paired with lane i ^ j
+// and belongs to an ascending sequence when (i & k) == 0
+constexpr int maxLanes(int k, int j, int width) {
+    int mask = 0;
+    for (int i = 0; i < width; ++i) {
+        bool ascending = (i & k) == 0;
+        if ((i < (i ^ j)) != ascending) mask |= 1 << i;
+    }
+    return mask;
+}
+
+// Bottom-up merge passes over sorted runs of length run; merge(a, na, b, nb,
+// out) merges two sorted runs into out
+template <typename Merge>
+static void mergePasses(int* data, int n, int run, Merge merge) {
+    vector<int> buffer(n);
+    int* src = data;
+    int* dst = buffer.data();
+    for (int width = run; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = min(lo + width, n), hi = min(lo + 2 * width, n);
+            if (mid == hi) {
+                copy(src + lo, src + hi, dst + lo);
+            } else {
+                merge(src + lo, mid - lo, src + mid, hi - mid, dst + lo);
+            }
         }
+        swap(src, dst);
+    }
+    if (src != data) {
+        copy(src, src + n, data);
+    }
+}
+
+#ifdef BITONIC_SIMD
+// Without optimization every vector lives on the stack, so the kernels are
+// compiled with -O2 whatever the build flags are
+#pragma GCC push_options
+#pragma GCC optimize("O2")
+
+// ---- AVX2: 8 lanes ----
+
+__attribute__((target("avx2")))
+static SIMD_INLINE __m256i xorPermutation8(int j) {
+    return _mm256_xor_si256(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(j));
+}
+
+template <int K, int J>
+__attribute__((target("avx2")))
+static SIMD_INLINE __m256i compareExchange8(__m256i v) {
+    constexpr int mask = maxLanes(K, J, 8);
+    __m256i partner = _mm256_permutevar8x32_epi32(v, xorPermutation8(J));
+    return _mm256_blend_epi32(_mm256_min_epi32(v, partner), _mm256_max_epi32(v, partner), mask);
+}
+
+// Sort the 8 lanes of a bitonic vector
+__attribute__((target("avx2")))
+static SIMD_INLINE __m256i bitonicClean8(__m256i v) {
+    v = compareExchange8<8, 4>(v);
+    v = compareExchange8<8, 2>(v);
+    return compareExchange8<8, 1>(v);
+}
+
+__attribute__((target("avx2")))
+static SIMD_INLINE __m256i sort8(__m256i v) {
+    v = compareExchange8<2, 1>(v);
+    v = compareExchange8<4, 2>(v);
+    v = compareExchange8<4, 1>(v);
+    return bitonicClean8(v);
+}
+
+// Merge two sorted vectors: lo gets the 8 smallest, hi the 8 largest
+__attribute__((target("avx2")))
+static SIMD_INLINE void merge8(__m256i a, __m256i b, __m256i& lo, __m256i& hi) {
+    b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    lo = bitonicClean8(_mm256_min_epi32(a, b));
+    hi = bitonicClean8(_mm256_max_epi32(a, b));
+}
+
+// Load 8 elements of a run at pos; past its end the vector is padded with
+// INT_MAX, which sorts last and is cut off when the output is stored
+__attribute__((target("avx2")))
+static SIMD_INLINE __m256i loadRun8(const int* run, int n, int pos) {
+    if (pos + 8 <= n) return _mm256_loadu_si256((const __m256i*)(run + pos));
+    int tmp[8];
+    for (int i = 0; i < 8; ++i) tmp[i] = (pos + i < n) ? run[pos + i] : INT_MAX;
+    return _mm256_loadu_si256((const __m256i*)tmp);
+}
+
+__attribute__((target("avx2")))
+static SIMD_INLINE void storeRun8(int* out, int total, int pos, __m256i v) {
+    if (pos + 8 <= total) {
+        _mm256_storeu_si256((__m256i*)(out + pos), v);
+    } else if (pos < total) {
+        int tmp[8];
+        _mm256_storeu_si256((__m256i*)tmp, v);
+        copy(tmp, tmp + (total - pos), out + pos);
     }
 }
 
-// Function for parallel bitonic sort using MPI
-void bitonicSortParallel(vector<int>& local_data, int total_n, int rank, int size, MPI_Comm comm) {
+// Merge two sorted runs 8 elements at a time: the upper half of each merge
+// stays in a register and is merged with the next 8 elements of the run
+// whose next element is smaller
+__attribute__((target("avx2")))
+static void mergeRunsAvx2(const int* a, int na, const int* b, int nb, int* out) {
+    int total = na + nb;
+    __m256i lo, hi;
+    merge8(loadRun8(a, na, 0), loadRun8(b, nb, 0), lo, hi);
+    storeRun8(out, total, 0, lo);
+    int ia = 8, ib = 8, pos = 8;
+    while (ia < na || ib < nb) {
+        __m256i next;
+        if (ia < na && (ib >= nb || a[ia] <= b[ib])) {
+            next = loadRun8(a, na, ia);
+            ia += 8;
+        } else {
+            next = loadRun8(b, nb, ib);
+            ib += 8;
+        }
+        merge8(hi, next, lo, hi);
+        storeRun8(out, total, pos, lo);
+        pos += 8;
+    }
+    storeRun8(out, total, pos, hi);
+}
+
+__attribute__((target("avx2")))
+static void sortAvx2(int* data, int n) {
+    // Sorted runs of 16: two sorting networks and one merge
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo, hi;
+        merge8(sort8(_mm256_loadu_si256((const __m256i*)(data + i))),
+               sort8(_mm256_loadu_si256((const __m256i*)(data + i + 8))), lo, hi);
+        _mm256_storeu_si256((__m256i*)(data + i), lo);
+        _mm256_storeu_si256((__m256i*)(data + i + 8), hi);
+    }
+    localSort(data + i, n - i);
+    mergePasses(data, n, 16, mergeRunsAvx2);
+}
+
+// ---- AVX-512: 16 lanes ----
+
+// GCC's avx512fintrin.h trips -Wuninitialized on its own _mm512_undefined_epi32
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+template <int K, int J>
+__attribute__((target("avx512f")))
+static SIMD_INLINE __m512i compareExchange16(__m512i v) {
+    constexpr __mmask16 mask = maxLanes(K, J, 16);
+    __m512i index = _mm512_xor_si512(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                     _mm512_set1_epi32(J));
+    __m512i partner = _mm512_permutex2var_epi32(v, index, v);
+    return _mm512_mask_blend_epi32(mask, _mm512_min_epi32(v, partner),
+                                   _mm512_max_epi32(v, partner));
+}
+
+__attribute__((target("avx512f")))
+static SIMD_INLINE __m512i bitonicClean16(__m512i v) {
+    v = compareExchange16<16, 8>(v);
+    v = compareExchange16<16, 4>(v);
+    v = compareExchange16<16, 2>(v);
+    return compareExchange16<16, 1>(v);
+}
+
+__attribute__((target("avx512f")))
+static SIMD_INLINE __m512i sort16(__m512i v) {
+    v = compareExchange16<2, 1>(v);
+    v = compareExchange16<4, 2>(v);
+    v = compareExchange16<4, 1>(v);
+    v = compareExchange16<8, 4>(v);
+    v = compareExchange16<8, 2>(v);
+    v = compareExchange16<8, 1>(v);
+    return bitonicClean16(v);
+}
+
+__attribute__((target("avx512f")))
+static SIMD_INLINE void merge16(__m512i a, __m512i b, __m512i& lo, __m512i& hi) {
+    b = _mm512_permutex2var_epi32(b, _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), b);
+    lo = bitonicClean16(_mm512_min_epi32(a, b));
+    hi = bitonicClean16(_mm512_max_epi32(a, b));
+}
+
+__attribute__((target("avx512f")))
+static SIMD_INLINE __m512i loadRun16(const int* run, int n, int pos) {
+    if (pos + 16 <= n) return _mm512_loadu_si512(run + pos);
+    __mmask16 valid = pos < n ? (__mmask16)((1u << (n - pos)) - 1) : 0;
+    return _mm512_mask_loadu_epi32(_mm512_set1_epi32(INT_MAX), valid, run + pos);
+}
+
+__attribute__((target("avx512f")))
+static SIMD_INLINE void storeRun16(int* out, int total, int pos, __m512i v) {
+    if (pos + 16 <= total) {
+        _mm512_storeu_si512(out + pos, v);
+    } else if (pos < total) {
+        _mm512_mask_storeu_epi32(out + pos, (__mmask16)((1u << (total - pos)) - 1), v);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void mergeRunsAvx512(const int* a, int na, const int* b, int nb, int* out) {
+    int total = na + nb;
+    __m512i lo, hi;
+    merge16(loadRun16(a, na, 0), loadRun16(b, nb, 0), lo, hi);
+    storeRun16(out, total, 0, lo);
+    int ia = 16, ib = 16, pos = 16;
+    while (ia < na || ib < nb) {
+        __m512i next;
+        if (ia < na && (ib >= nb || a[ia] <= b[ib])) {
+            next = loadRun16(a, na, ia);
+            ia += 16;
+        } else {
+            next = loadRun16(b, nb, ib);
+            ib += 16;
+        }
+        merge16(hi, next, lo, hi);
+        storeRun16(out, total, pos, lo);
+        pos += 16;
+    }
+    storeRun16(out, total, pos, hi);
+}
+
+__attribute__((target("avx512f")))
+static void sortAvx512(int* data, int n) {
+    // Sorted runs of 32: two sorting networks and one merge
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i lo, hi;
+        merge16(sort16(_mm512_loadu_si512(data + i)), sort16(_mm512_loadu_si512(data + i + 16)), lo, hi);
+        _mm512_storeu_si512(data + i, lo);
+        _mm512_storeu_si512(data + i + 16, hi);
+    }
+    localSort(data + i, n - i);
+    mergePasses(data, n, 32, mergeRunsAvx512);
+}
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+// Sort the local block with the widest SIMD kernel the CPU supports
+void simdSort(int* data, int n) {
+#ifdef BITONIC_SIMD
+    static const int level = __builtin_cpu_supports("avx512f") ? 2 : __builtin_cpu_supports("avx2") ? 1 : 0;
+    if (n >= 64 && level == 2) {
+        sortAvx512(data, n);
+        return;
+    }
+    if (n >= 64 && level == 1) {
+        sortAvx2(data, n);
+        return;
+    }
+#endif
+    localSort(data, n);
+}
+
+// Compare-split of two sorted blocks of block_size slots. Slots past the real
+// elements of a block are padding, which counts as larger than any value, so
+// only the real elements are stored and exchanged. local_data receives the
+// lower half of the merge if keep_low is set, otherwise the upper half.
+void bitonicMerge(vector<int>& local_data, const vector<int>& recv_data, int recv_n, int block_size,
+                  bool keep_low, vector<int>& merged) {
     int local_n = local_data.size();
-    vector<int> recv_buffer(local_n);
+    int real = local_n + recv_n;
+    if (keep_low) {
+        // The lower half holds the smallest real elements, up to a full block
+        int keep = min(block_size, real);
+        merged.resize(keep);
+        int i = 0, j = 0;
+        for (int k = 0; k < keep; k++) {
+            merged[k] = (j >= recv_n || (i < local_n && local_data[i] <= recv_data[j])) ? local_data[i++] : recv_data[j++];
+        }
+    } else {
+        // The upper half starts with all the padding of both blocks
+        int keep = max(0, real - block_size);
+        merged.resize(keep);
+        int i = local_n - 1, j = recv_n - 1;
+        for (int k = keep - 1; k >= 0; k--) {
+            merged[k] = (j < 0 || (i >= 0 && local_data[i] > recv_data[j])) ? local_data[i--] : recv_data[j--];
+        }
+    }
+    local_data.swap(merged);
+}
+
+// Function for parallel bitonic sort using MPI. Every process holds a block
+// of block_size slots, of which local_data are the real elements. Any number
+// of processes works: the network runs on the next power of two, and the
+// missing ranks are treated as ghosts whose blocks are all padding.
+void bitonicSortParallel(vector<int>& local_data, int block_size, int rank, int size, MPI_Comm comm) {
+    vector<int> recv_buffer(block_size), merged;
+    merged.reserve(block_size);
     
     // Each process starts with a locally sorted array
-    sort(local_data.begin(), local_data.end());
+    simdSort(local_data.data(), local_data.size());
     
-    // Main bitonic sort algorithm
-    for (int step = 1; step < size; step = step << 1) {
-        for (int substep = step; substep > 0; substep = substep >> 1) {
+    int dims = 1;
+    while (dims < size) {
+        dims <<= 1;
+    }
+    
+    // Main bitonic sort algorithm: stage k merges sorted sequences of k/2
+    // blocks. The first step of a stage pairs each block with its mirror image
+    // in the group of k, which replaces sorting every other sequence in
+    // descending order, so the lower rank always keeps the smaller half.
+    for (int k = 2; k <= dims; k = k << 1) {
+        for (int j = k >> 1; j > 0; j = j >> 1) {
             // Find partner process for this substep
-            int partner = rank ^ substep;
+            int partner = (j == k >> 1) ? (rank ^ (k - 1)) : (rank ^ j);
             
-            // Skip invalid partners
+            // A ghost holds only padding and is always the higher rank, so the
+            // exchange would leave both blocks unchanged
             if (partner >= size) continue;
             
-            // Determine sort direction
-            bool dir = ((rank / (2 * substep)) % 2 == 0);
-            
-            // Exchange data with partner
-            MPI_Sendrecv(local_data.data(), local_n, MPI_INT, partner, 0,
-                        recv_buffer.data(), local_n, MPI_INT, partner, 0,
-                        comm, MPI_STATUS_IGNORE);
+            // Exchange the real elements with partner
+            MPI_Status status;
+            int recv_n = 0;
+            MPI_Sendrecv(local_data.data(), local_data.size(), MPI_INT, partner, 0,
+                        recv_buffer.data(), block_size, MPI_INT, partner, 0,
+                        comm, &status);
+            MPI_Get_count(&status, MPI_INT, &recv_n);
             
-            // Determine which half to keep based on rank and partner
-            if (rank < partner) {
-                // Compare-split operation: keep smaller elements if rank < partner
-                bitonicMerge(local_data, recv_buffer, dir);
-            } else {
-                // Compare-split operation: keep larger elements if rank > partner
-                bitonicMerge(recv_buffer, local_data, dir);
-            }
+            // The lower rank keeps the smaller half
+            bitonicMerge(local_data, recv_buffer, recv_n, block_size, rank < partner, merged);
         }
     }
 }
 
 // Wrapper function for bitonic sort
 bool runBitonicSort(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm) {
-    vector<int> global_array;
+    vector<int> local_data;
     int n = 0;
     
-    // Root process reads the input file
-    if (rank == 0) {
-        ifstream file(inputFile);
-        int el;
-        while (file >> el) {
-            global_array.push_back(el);
-        }
-        file.close();
-        n = global_array.size();
-        
-        // Check if the number of processes is a power of 2
-        if ((size & (size - 1)) != 0) {
-            cout << "Error: Number of processes must be a power of 2 for bitonic sort.\n";
-            n = -1;  // Signal error
-        }
-        
-        // Print the unsorted array
-        if (n > 0) {
-            ofstream outFile(outputFile);
-            outFile << "Unsorted array: ";
-            for (int i = 0; i < min(n, 100); i++) {  // Only print first 100 elements
-                outFile << global_array[i] << " ";
-            }
-            if (n > 100) outFile << "...";
-            outFile << endl;
-            outFile.close();
+    // Every process reads its own block of the input file
+    if (!readLocalPartition(inputFile, local_data, n, rank, size, comm)) {
+        if (rank == 0) {
+            cout << "Error: Unable to read " << inputFile << endl;
         }
+        return false;
     }
     
-    // Broadcast array size to all processes
-    MPI_Bcast(&n, 1, MPI_INT, 0, comm);
-    
-    // If error occurred, return false
     if (n <= 0) {
         return false;
     }
     
-    // For optimal bitonic sort with p processes:
-    // 1. Number of processes must be a power of 2
-    // 2. Each process should have equal number of elements
-    
-    // Calculate elements per process (ceil division to ensure all elements are processed)
-    int elements_per_process = (n + size - 1) / size;
-    
-    // Make elements_per_process a power of 2 if it's not already
-    int power_of_two = 1;
-    while (power_of_two < elements_per_process) {
-        power_of_two *= 2;
-    }
-    elements_per_process = power_of_two;
-    
-    // Calculate padded size to make total elements a multiple of elements_per_process * size
-    int padded_size = elements_per_process * size;
-    
-    // Allocate local array with padding
-    vector<int> local_data(elements_per_process, INT_MAX);
-    
-    // Distribute data from root
-    if (rank == 0) {
-        // Pad the global array if needed
-        global_array.resize(padded_size, INT_MAX);
+    // Print the unsorted array (text output only)
+    vector<int> preview = gatherPrefix(local_data, n, 100, rank, size, comm);  // Only print first 100 elements
+    if (rank == 0 && !isBinaryOutput(outputFile)) {
+        ofstream outFile(outputFile);
+        outFile << "Unsorted array: ";
+        for (int el : preview) {
+            outFile << el << " ";
+        }
+        if (n > 100) outFile << "...";
+        outFile << endl;
+        outFile.close();
     }
     
-    // Scatter data to all processes
-    MPI_Scatter(rank == 0 ? global_array.data() : nullptr,
-               elements_per_process, MPI_INT,
-               local_data.data(), elements_per_process, MPI_INT,
-               0, comm);
+    // Every process gets a block of ceil(n / size) slots; the blocks read by
+    // readLocalPartition differ by at most one element, so each one is short
+    // of a full block by at most one padding slot
+    int block_size = (n + size - 1) / size;
     
     // Start timing
     MPI_Barrier(comm);
     double start_time = MPI_Wtime();
     
     // Perform parallel bitonic sort
-    bitonicSortParallel(local_data, padded_size, rank, size, comm);
+    bitonicSortParallel(local_data, block_size, rank, size, comm);
     
     // End timing
     double end_time = MPI_Wtime();
@@ -155,44 +413,39 @@ bool runBitonicSort(const char* inputFile, const char* outputFile, int rank, int
     double max_time;
     MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
     
-    // Gather results back to root
-    vector<int> result;
-    if (rank == 0) {
-        result.resize(padded_size);
-    }
-    
-    MPI_Gather(local_data.data(), elements_per_process, MPI_INT,
-              result.data(), elements_per_process, MPI_INT,
-              0, comm);
-    
-    // Root process finalizes the sort and writes output
     if (rank == 0) {
-        // Remove padding
-        result.erase(
-            remove_if(result.begin(), result.end(),
-                     [](int x) { return x == INT_MAX; }),
-            result.end());
-        
-        // Verify the result is sorted
-        bool is_sorted = std::is_sorted(result.begin(), result.end());
-        
         // Print execution time
         double duration = max_time * 1000; // Convert to milliseconds
         cout << "Bitonic Sort execution time: " << duration << " ms\n";
-        if (!is_sorted) {
-            cout << "Warning: Final array is not sorted correctly.\n";
+    }
+    
+    // Every process writes its sorted chunk at its global offset
+    if (!writeDistributedArray(outputFile, local_data.data(), local_data.size(), "Sorted array: ", true, rank, size, comm)) {
+        if (rank == 0) {
+            cout << "Error: Unable to write " << outputFile << endl;
         }
-        
-        // Write sorted array to output file
-        ofstream outFile(outputFile, ios::app);
-        outFile << "Sorted array: ";
-        for (int i = 0; i < min((int)result.size(), 100); i++) {  // Only print first 100 elements
-            outFile << result[i] << " ";
+        return false;
+    }
+    
+    return true;
+}
+
+// Sorts inputFile and leaves the result distributed instead of writing it:
+// sorted_data holds elements [global_offset, global_offset + sorted_data.size())
+// of the sorted array. The network leaves the padding on the highest ranks,
+// so a rebalance gives every process floor(n/p) or ceil(n/p) elements.
+bool runBitonicSortDistributed(const char* inputFile, vector<int>& sorted_data, long long& global_offset,
+                               int rank, int size, MPI_Comm comm) {
+    int n = 0;
+    if (!readLocalPartition(inputFile, sorted_data, n, rank, size, comm) || n <= 0) {
+        if (rank == 0) {
+            cout << "Error: Unable to read " << inputFile << endl;
         }
-        if (result.size() > 100) outFile << "...";
-        outFile << endl;
-        outFile.close();
+        return false;
     }
     
+    bitonicSortParallel(sorted_data, (n + size - 1) / size, rank, size, comm);
+    rebalancePartition(sorted_data, n, rank, size, comm);
+    global_offset = blockOffset(n, size, rank);
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <mpi.h>
+
+using namespace std;
+
+extern bool readLocalPartition(const char *inputFile, vector<int> &local_data, int &total_n, int rank, int size, MPI_Comm comm);
+extern bool writeDistributedArray(const char *outputFile, const int *data, int local_n, const char *label, bool append, int rank, int size, MPI_Comm comm);
+extern bool isBinaryOutput(const char *outputFile);
+extern long long blockOffset(int total, int size, int r);
+extern void rebalancePartition(vector<int> &local_data, int total_n, int rank, int size, MPI_Comm comm);
+extern void merge_received_runs(const int *recv_buf, const int *recv_counts, const int *recv_displs,
+                                int size, int recv_size, int *out);
+extern void localSort(int *data, int n);
+
+// A splitter is accepted once the number of elements below it is within
+// HISTOGRAM_SORT_TOLERANCE * n/p of its target (0 = exact balance)
+#ifndef HISTOGRAM_SORT_TOLERANCE
+#define HISTOGRAM_SORT_TOLERANCE 0.02
+#endif
+
+// Candidates probed per open splitter and round; every round narrows the
+// value interval of a splitter by a factor HISTOGRAM_SORT_PROBES + 1
+#ifndef HISTOGRAM_SORT_PROBES
+#define HISTOGRAM_SORT_PROBES 8
+#endif
+
+// The search for splitter i: the global count of elements below a value v is
+// f(v), and the splitter needs f(v) close to target. f(lo) <= target <= f(hi)
+// holds throughout; values are long long so that hi can be INT_MAX + 1.
+struct SplitterSearch
+{
+    long long target;
+    long long lo, hi;
+    long long count_lo, count_hi;
+    bool done;
+
+    // Result: every element below value, plus the first take copies of value
+    // in rank order, goes before the splitter
+    long long value, take;
+};
+
+// Number of local elements below v (local_data is sorted)
+long long count_below(const vector<int> &local_data, long long v)
+{
+    if (v > INT_MAX)
+        return local_data.size();
+    if (v <= INT_MIN)
+        return 0;
+    return lower_bound(local_data.begin(), local_data.end(), (int)v) - local_data.begin();
+}
+
+// Finds the size - 1 splitters whose global ranks are the block boundaries
+// blockOffset(n, p, i). Every round each open splitter probes
+// HISTOGRAM_SORT_PROBES values inside its interval; one MPI_Allreduce sums the
+// local counts of all probes. A splitter whose interval has shrunk to one value
+// without meeting the tolerance sits inside a run of equal keys: those copies
+// are then shared out in rank order. Returns the number of rounds.
+int refine_splitters(const vector<int> &local_data, int total_n, int size, MPI_Comm comm,
+                     vector<SplitterSearch> &splitters)
+{
+    long long tolerance = (long long)(HISTOGRAM_SORT_TOLERANCE * total_n / size);
+
+    // The search starts from the global value range: {-min, max} in one MPI_MAX
+    long long range[2] = {-(long long)INT_MAX, INT_MIN}, global_range[2];
+    if (!local_data.empty())
+    {
+        range[0] = -(long long)local_data.front();
+        range[1] = local_data.back();
+    }
+    MPI_Allreduce(range, global_range, 2, MPI_LONG_LONG, MPI_MAX, comm);
+
+    splitters.assign(size - 1, SplitterSearch());
+    for (int i = 0; i < size - 1; i++)
+    {
+        SplitterSearch &s = splitters[i];
+        s.target = blockOffset(total_n, size, i + 1);
+        s.lo = -global_range[0];
+        s.hi = global_range[1] + 1;
+        s.count_lo = 0;
+        s.count_hi = total_n;
+        s.done = false;
+        s.take = 0;
+
+        // The interval ends may already be good enough
+        if (s.target - s.count_lo <= tolerance)
+        {
+            s.value = s.lo;
+            s.done = true;
+        }
+        else if (s.count_hi - s.target <= tolerance)
+        {
+            s.value = s.hi;
+            s.done = true;
+        }
+    }
+
+    int rounds = 0;
+    vector<long long> probes, local_counts, global_counts;
+    vector<int> owner;
+    while (true)
+    {
+        probes.clear();
+        owner.clear();
+        for (int i = 0; i < size - 1; i++)
+        {
+            SplitterSearch &s = splitters[i];
+            if (s.done)
+                continue;
+            // Equal keys only: give the splitter its share of the copies of lo
+            if (s.hi - s.lo == 1)
+            {
+                s.value = s.lo;
+                s.take = s.target - s.count_lo;
+                s.done = true;
+                continue;
+            }
+            long long steps = min<long long>(HISTOGRAM_SORT_PROBES, s.hi - s.lo - 1);
+            for (long long j = 1; j <= steps; j++)
+            {
+                probes.push_back(s.lo + (s.hi - s.lo) * j / (steps + 1));
+                owner.push_back(i);
+            }
+        }
+
+        // Every process sees the same splitters, so they all stop together
+        if (probes.empty())
+            break;
+        rounds++;
+
+        local_counts.resize(probes.size());
+        global_counts.resize(probes.size());
+        for (size_t k = 0; k < probes.size(); k++)
+            local_counts[k] = count_below(local_data, probes[k]);
+        MPI_Allreduce(local_counts.data(), global_counts.data(), probes.size(), MPI_LONG_LONG, MPI_SUM, comm);
+
+        for (size_t k = 0; k < probes.size(); k++)
+        {
+            SplitterSearch &s = splitters[owner[k]];
+            if (s.done)
+                continue;
+            long long count = global_counts[k];
+            if (llabs(count - s.target) <= tolerance)
+            {
+                s.value = probes[k];
+                s.done = true;
+            }
+            else if (count < s.target)
+            {
+                s.lo = probes[k];
+                s.count_lo = count;
+            }
+            else if (probes[k] < s.hi)
+            {
+                s.hi = probes[k];
+                s.count_hi = count;
+            }
+        }
+    }
+    return rounds;
+}
+
+// Local end of every bucket: elements below the splitter value, plus this
+// process's part of the copies of the value that the splitter takes. An
+// MPI_Exscan of the local copy counts tells each process how many copies the
+// lower ranks already hold.
+void bucket_bounds(const vector<int> &local_data, const vector<SplitterSearch> &splitters,
+                   int rank, int size, MPI_Comm comm, vector<int> &bounds)
+{
+    int parts = size - 1;
+    vector<long long> below(parts), equal(parts), equal_before(parts, 0);
+    for (int i = 0; i < parts; i++)
+    {
+        below[i] = count_below(local_data, splitters[i].value);
+        equal[i] = count_below(local_data, splitters[i].value + 1) - below[i];
+    }
+    if (parts > 0)
+        MPI_Exscan(equal.data(), equal_before.data(), parts, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0)
+        fill(equal_before.begin(), equal_before.end(), 0);
+
+    bounds.assign(size + 1, 0);
+    bounds[size] = local_data.size();
+    for (int i = 0; i < parts; i++)
+    {
+        long long mine = min(max(splitters[i].take - equal_before[i], 0LL), equal[i]);
+        // Splitters accepted within the tolerance may overlap; keep them ordered
+        bounds[i + 1] = max<long long>(bounds[i], below[i] + mine);
+    }
+}
+
+// Sorts the distributed array: on return local_data is this process's bucket,
+// sorted, and the buckets of the ranks follow each other in global order.
+// Returns the number of refinement rounds.
+int histogram_sort_buckets(vector<int> &local_data, int total_n, int rank, int size, MPI_Comm comm)
+{
+    localSort(local_data.data(), local_data.size());
+
+    vector<SplitterSearch> splitters;
+    int rounds = refine_splitters(local_data, total_n, size, comm, splitters);
+
+    // Bucket i of this process is local_data[bounds[i] .. bounds[i + 1])
+    vector<int> bounds;
+    bucket_bounds(local_data, splitters, rank, size, comm, bounds);
+    vector<int> send_counts(size), send_displs(size), recv_counts(size), recv_displs(size, 0);
+    for (int i = 0; i < size; i++)
+    {
+        send_displs[i] = bounds[i];
+        send_counts[i] = bounds[i + 1] - bounds[i];
+    }
+
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int i = 1; i < size; i++)
+        recv_displs[i] = recv_displs[i - 1] + recv_counts[i - 1];
+    int recv_size = recv_displs[size - 1] + recv_counts[size - 1];
+
+    vector<int> recv_buf(max(recv_size, 1));
+    MPI_Alltoallv(local_data.data(), send_counts.data(), send_displs.data(), MPI_INT,
+                  recv_buf.data(), recv_counts.data(), recv_displs.data(), MPI_INT, comm);
+
+    // Every sender's bucket is sorted, so merging the runs is enough
+    local_data.resize(recv_size);
+    merge_received_runs(recv_buf.data(), recv_counts.data(), recv_displs.data(), size, recv_size, local_data.data());
+    return rounds;
+}
+
+bool runHistogramSort(const char *inputFile, const char *outputFile, int rank, int size, MPI_Comm comm)
+{
+    int total_n = 0;
+
+    vector<int> local_data;
+    if (!readLocalPartition(inputFile, local_data, total_n, rank, size, comm))
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Unable to read " << inputFile << "\n";
+        }
+        return false;
+    }
+
+    if (total_n <= 0)
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Invalid input array size\n";
+        }
+        return false;
+    }
+
+    // Every process writes its block of the unsorted input (text output only)
+    if (!isBinaryOutput(outputFile) &&
+        !writeDistributedArray(outputFile, local_data.data(), local_data.size(), "Unsorted array: ", false, rank, size, comm))
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Unable to write " << outputFile << "\n";
+        }
+        return false;
+    }
+
+    MPI_Barrier(comm);
+    double start_time = MPI_Wtime();
+
+    int rounds = histogram_sort_buckets(local_data, total_n, rank, size, comm);
+
+    double end_time = MPI_Wtime();
+    MPI_Barrier(comm);
+
+    int recv_size = local_data.size();
+    int max_bucket = 0;
+    MPI_Reduce(&recv_size, &max_bucket, 1, MPI_INT, MPI_MAX, 0, comm);
+
+    if (rank == 0)
+    {
+        cout << "Histogram Sort execution time: " << (end_time - start_time) * 1000 << " ms\n";
+        cout << "Histogram Sort splitter rounds: " << rounds
+             << ", bucket imbalance (max/avg): " << max_bucket / ((double)total_n / size) << "\n";
+    }
+
+    // Every process writes its sorted bucket at its global offset
+    return writeDistributedArray(outputFile, local_data.data(), recv_size, "Sorted array: ", true, rank, size, comm);
+}
+
+// Sorts inputFile and leaves the result distributed instead of writing it:
+// sorted_data holds elements [global_offset, global_offset + sorted_data.size())
+// of the sorted array, floor(n/p) or ceil(n/p) of them on every process
+bool runHistogramSortDistributed(const char *inputFile, vector<int> &sorted_data, long long &global_offset,
+                                 int rank, int size, MPI_Comm comm)
+{
+    int total_n = 0;
+    if (!readLocalPartition(inputFile, sorted_data, total_n, rank, size, comm) || total_n <= 0)
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Unable to read " << inputFile << "\n";
+        }
+        return false;
+    }
+
+    // The buckets are within the tolerance of n/p; the rebalance moves the rest
+    histogram_sort_buckets(sorted_data, total_n, rank, size, comm);
+    rebalancePartition(sorted_data, total_n, rank, size, comm);
+    global_offset = blockOffset(total_n, size, rank);
+    return true;
+}
\ No newline at end of file
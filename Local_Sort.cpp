@@ -0,0 +1,348 @@
+#include <algorithm>
+
+using namespace std;
+
+// Local sort shared by the sorting algorithms: a pattern-defeating quicksort
+// (pdqsort). It partitions with a branchless block kernel, splits off runs of
+// keys equal to an earlier pivot, recognises sorted ranges in linear time and
+// falls back to heapsort when the pivots keep failing, so no input is worse
+// than O(n log n) and the recursion stays O(log n) deep.
+
+// Ranges up to this size are insertion sorted
+const int LOCAL_SORT_INSERTION = 24;
+
+// Above this size the pivot is the median of three medians of three
+const int LOCAL_SORT_NINTHER = 128;
+
+// Elements classified per block by the branchless partition (offsets fit a byte)
+const int LOCAL_SORT_BLOCK = 64;
+
+// Element moves a partial insertion sort may make before it gives up
+const int LOCAL_SORT_PARTIAL_LIMIT = 8;
+
+static void insertion_sort(int *a, int n)
+{
+    for (int i = 1; i < n; i++)
+    {
+        int x = a[i];
+        int j = i;
+        while (j > 0 && x < a[j - 1])
+        {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = x;
+    }
+}
+
+// Insertion sort that gives up after LOCAL_SORT_PARTIAL_LIMIT moves; returns
+// true if the range is sorted
+static bool partial_insertion_sort(int *a, int n)
+{
+    int moves = 0;
+    for (int i = 1; i < n; i++)
+    {
+        int x = a[i];
+        int j = i;
+        while (j > 0 && x < a[j - 1])
+        {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = x;
+        moves += i - j;
+        if (moves > LOCAL_SORT_PARTIAL_LIMIT)
+            return false;
+    }
+    return true;
+}
+
+static void sift_down(int *a, int n, int i)
+{
+    int x = a[i];
+    while (true)
+    {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && a[child] < a[child + 1])
+            child++;
+        if (!(x < a[child]))
+            break;
+        a[i] = a[child];
+        i = child;
+    }
+    a[i] = x;
+}
+
+static void heap_sort(int *a, int n)
+{
+    for (int i = n / 2 - 1; i >= 0; i--)
+        sift_down(a, n, i);
+    for (int end = n - 1; end > 0; end--)
+    {
+        swap(a[0], a[end]);
+        sift_down(a, end, 0);
+    }
+}
+
+// Orders three elements so that *b is their median
+static void sort3(int *a, int *b, int *c)
+{
+    if (*b < *a)
+        swap(*a, *b);
+    if (*c < *b)
+        swap(*b, *c);
+    if (*b < *a)
+        swap(*a, *b);
+}
+
+// Partitions a[1 .. n) around the pivot a[0]: elements below it to the left,
+// the others to the right, and the pivot between them. Returns the pivot's
+// position; already_partitioned is set if no element had to move.
+//
+// The middle of the range is partitioned in blocks without branches (Edelkamp
+// and Weiss, BlockQuicksort): the offsets of the misplaced elements of a left
+// and a right block are collected by adding comparison results, then swapped
+// in pairs. Everything left of first is below the pivot and everything from
+// last on is not, so the remainder can be finished with a plain scan.
+static int partition_right(int *a, int n, bool &already_partitioned)
+{
+    int pivot = a[0];
+    int *first = a + 1;
+    int *last = a + n;
+    while (first < last && *first < pivot)
+        first++;
+    while (first < last && !(last[-1] < pivot))
+        last--;
+    already_partitioned = first >= last;
+
+    unsigned char offsets_l[LOCAL_SORT_BLOCK], offsets_r[LOCAL_SORT_BLOCK];
+    int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+    while (last - first >= 2 * LOCAL_SORT_BLOCK)
+    {
+        if (num_l == 0)
+        {
+            start_l = 0;
+            for (int i = 0; i < LOCAL_SORT_BLOCK; i++)
+            {
+                offsets_l[num_l] = i;
+                num_l += !(first[i] < pivot);
+            }
+        }
+        if (num_r == 0)
+        {
+            start_r = 0;
+            for (int i = 0; i < LOCAL_SORT_BLOCK; i++)
+            {
+                offsets_r[num_r] = i + 1;
+                num_r += last[-1 - i] < pivot;
+            }
+        }
+
+        int num = min(num_l, num_r);
+        for (int k = 0; k < num; k++)
+            swap(first[offsets_l[start_l + k]], *(last - offsets_r[start_r + k]));
+        num_l -= num;
+        num_r -= num;
+        start_l += num;
+        start_r += num;
+        if (num_l == 0)
+            first += LOCAL_SORT_BLOCK;
+        if (num_r == 0)
+            last -= LOCAL_SORT_BLOCK;
+    }
+
+    while (true)
+    {
+        while (first < last && *first < pivot)
+            first++;
+        while (first < last && !(last[-1] < pivot))
+            last--;
+        if (first >= last)
+            break;
+        swap(*first, last[-1]);
+        first++;
+        last--;
+    }
+
+    int pos = (first - a) - 1;
+    a[0] = a[pos];
+    a[pos] = pivot;
+    return pos;
+}
+
+// Three-way split for a pivot equal to the element before the range, which
+// is not larger than any element of the range: the copies of the pivot go to
+// the left and are final, the larger elements to the right. Returns the
+// position of the last copy. Runs of equal keys are thereby sorted in one
+// pass, so k distinct keys cost O(n log k).
+static int partition_left(int *a, int n)
+{
+    int pivot = a[0];
+    int *first = a + 1;
+    int *last = a + n;
+    while (true)
+    {
+        while (first < last && !(pivot < *first))
+            first++;
+        while (first < last && pivot < last[-1])
+            last--;
+        if (first >= last)
+            break;
+        swap(*first, last[-1]);
+        first++;
+        last--;
+    }
+
+    int pos = (first - a) - 1;
+    a[0] = a[pos];
+    a[pos] = pivot;
+    return pos;
+}
+
+// Sorts a[0 .. n). Unless leftmost, a[-1] is an element not larger than any
+// of the range. bad_allowed unbalanced partitions are tolerated before the
+// range is heapsorted. Recurses into the smaller side and loops on the larger.
+static void pdq_loop(int *a, int n, int bad_allowed, bool leftmost)
+{
+    while (true)
+    {
+        if (n <= LOCAL_SORT_INSERTION)
+        {
+            insertion_sort(a, n);
+            return;
+        }
+
+        // Move the pivot to a[0]
+        int half = n / 2;
+        if (n > LOCAL_SORT_NINTHER)
+        {
+            sort3(a, a + half, a + n - 1);
+            sort3(a + 1, a + half - 1, a + n - 2);
+            sort3(a + 2, a + half + 1, a + n - 3);
+            sort3(a + half - 1, a + half, a + half + 1);
+            swap(a[0], a[half]);
+        }
+        else
+        {
+            sort3(a + half, a, a + n - 1);
+        }
+
+        if (!leftmost && !(a[-1] < a[0]))
+        {
+            int pos = partition_left(a, n);
+            a += pos + 1;
+            n -= pos + 1;
+            continue;
+        }
+
+        bool already_partitioned;
+        int pos = partition_right(a, n, already_partitioned);
+        int l = pos, r = n - pos - 1;
+
+        if (l < n / 8 || r < n / 8)
+        {
+            // A bad pivot: give up on quicksort after too many of them,
+            // otherwise shuffle a few elements to break the input's pattern
+            if (--bad_allowed == 0)
+            {
+                heap_sort(a, n);
+                return;
+            }
+            if (l >= LOCAL_SORT_INSERTION)
+            {
+                swap(a[0], a[l / 4]);
+                swap(a[l - 1], a[l - l / 4]);
+            }
+            if (r >= LOCAL_SORT_INSERTION)
+            {
+                swap(a[pos + 1], a[pos + 1 + r / 4]);
+                swap(a[n - 1], a[n - r / 4]);
+            }
+        }
+        else if (already_partitioned && partial_insertion_sort(a, l) &&
+                 partial_insertion_sort(a + pos + 1, r))
+        {
+            // A good pivot that moved nothing: the input is probably sorted,
+            // and both sides turned out to be
+            return;
+        }
+
+        if (l < r)
+        {
+            pdq_loop(a, l, bad_allowed, leftmost);
+            a += pos + 1;
+            n = r;
+            leftmost = false;
+        }
+        else
+        {
+            pdq_loop(a + pos + 1, r, bad_allowed, false);
+            n = l;
+        }
+    }
+}
+
+// Sorts data[0 .. n) in place in O(n log n) time, O(n) for sorted input
+void localSort(int *data, int n)
+{
+    if (n < 2)
+        return;
+    int log_n = 0;
+    while ((1 << (log_n + 1)) <= n && log_n < 30)
+        log_n++;
+    pdq_loop(data, n, log_n, true);
+}
+
+#ifdef LOCAL_SORT_BENCH
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+
+// Benchmark against std::sort on one process:
+//   g++ -O2 -DLOCAL_SORT_BENCH -o local_sort_bench Local_Sort.cpp
+//   ./local_sort_bench [n]
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1 << 22;
+    mt19937 gen(42);
+
+    const char *names[] = {"random", "sorted", "reversed", "few distinct", "all equal", "organ pipe", "sawtooth"};
+    cout << "input\tlocalSort (ms)\tstd::sort (ms)\n";
+    for (int kind = 0; kind < 7; kind++)
+    {
+        vector<int> input(n);
+        for (int i = 0; i < n; i++)
+        {
+            switch (kind)
+            {
+            case 0: input[i] = (int)gen(); break;
+            case 1: input[i] = i; break;
+            case 2: input[i] = n - i; break;
+            case 3: input[i] = gen() % 16; break;
+            case 4: input[i] = 7; break;
+            case 5: input[i] = min(i, n - i); break;
+            default: input[i] = i % 1000; break;
+            }
+        }
+
+        vector<int> a = input, b = input;
+        auto t0 = chrono::steady_clock::now();
+        localSort(a.data(), n);
+        auto t1 = chrono::steady_clock::now();
+        sort(b.begin(), b.end());
+        auto t2 = chrono::steady_clock::now();
+        if (a != b)
+        {
+            cout << "Error: " << names[kind] << " input is not sorted\n";
+            return 1;
+        }
+        cout << names[kind] << "\t" << chrono::duration<double, milli>(t1 - t0).count() << "\t"
+             << chrono::duration<double, milli>(t2 - t1).count() << "\n";
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,612 @@
+#include <mpi.h>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <charconv>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+// Binary dataset container: a 32-byte header followed by the elements in
+// native byte order. The checksum is position weighted, sum((i + 1) * v[i])
+// mod 2^64, so every rank can verify its own slice and the parts are added up.
+const char DATASET_MAGIC[4] = {'P', 'S', 'D', 'B'};
+const uint16_t DATASET_VERSION = 1;
+const uint16_t DATASET_INT32 = 1;
+const uint16_t DATASET_UINT64 = 2;
+const uint32_t DATASET_SORTED = 1;  // flag: elements are in ascending order
+
+struct DatasetHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t elem_type;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t checksum;
+};
+static_assert(sizeof(DatasetHeader) == 32, "dataset header must stay 32 bytes");
+
+// Largest piece handed to a single MPI-IO call (counts are plain ints)
+const MPI_Offset IO_PIECE = 1 << 30;
+
+// Extra bytes read past the end of a slice so that a number straddling
+// the boundary can be completed without a second round trip
+const MPI_Offset TOKEN_OVERLAP = 64;
+
+// Element types the input layer can load: int (the sorting and searching
+// algorithms) and uint64_t (primality test candidates)
+template <typename T> static MPI_Datatype mpiType();
+template <> MPI_Datatype mpiType<int>() { return MPI_INT; }
+template <> MPI_Datatype mpiType<uint64_t>() { return MPI_UINT64_T; }
+
+template <typename T> static uint16_t datasetType();
+template <> uint16_t datasetType<int>() { return DATASET_INT32; }
+template <> uint16_t datasetType<uint64_t>() { return DATASET_UINT64; }
+
+// Number of elements owned by rank r when total elements are split in blocks
+// (ranks below total % size hold one extra element)
+int blockCount(int total, int size, int r) {
+    return total / size + (r < total % size ? 1 : 0);
+}
+
+// Global index of the first element owned by rank r
+long long blockOffset(int total, int size, int r) {
+    return (long long)(total / size) * r + min(r, total % size);
+}
+
+// Read len bytes at offset into buf, splitting the request into int-sized pieces
+static bool readBytes(MPI_File fh, MPI_Offset offset, char* buf, MPI_Offset len) {
+    while (len > 0) {
+        int piece = (int)min(len, IO_PIECE);
+        if (MPI_File_read_at(fh, offset, buf, piece, MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+            return false;
+        }
+        offset += piece;
+        buf += piece;
+        len -= piece;
+    }
+    return true;
+}
+
+static inline bool isTokenChar(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+';
+}
+
+// Parse the numbers of a byte slice [begin, end) of the file. A number belongs
+// to the slice its first character lies in: a number cut by begin is skipped
+// (the previous rank owns it) and a number cut by end is completed by reading
+// past end. Negative numbers are read as 0 for unsigned element types.
+template <typename T>
+static bool parseTextSlice(MPI_File fh, MPI_Offset file_size, MPI_Offset begin, MPI_Offset end,
+                           vector<T>& values) {
+    MPI_Offset lo = (begin > 0) ? begin - 1 : 0;
+    MPI_Offset hi = min(file_size, end + TOKEN_OVERLAP);
+    vector<char> buf(hi - lo);
+    if (!readBytes(fh, lo, buf.data(), hi - lo)) {
+        return false;
+    }
+
+    size_t pos = begin - lo;
+    size_t limit = end - lo;
+
+    // Skip the tail of a number that started in the previous slice
+    if (begin > 0 && isTokenChar(buf[0])) {
+        while (pos < buf.size() && isTokenChar(buf[pos])) pos++;
+    }
+
+    while (pos < limit) {
+        if (!isTokenChar(buf[pos])) {
+            pos++;
+            continue;
+        }
+
+        // Make sure the whole number is in the buffer before parsing it
+        size_t stop = pos;
+        while (true) {
+            while (stop < buf.size() && isTokenChar(buf[stop])) stop++;
+            if (stop < buf.size() || lo + (MPI_Offset)buf.size() >= file_size) break;
+
+            MPI_Offset more = min(file_size - (lo + (MPI_Offset)buf.size()), TOKEN_OVERLAP);
+            size_t old_size = buf.size();
+            buf.resize(old_size + more);
+            if (!readBytes(fh, lo + old_size, buf.data() + old_size, more)) {
+                return false;
+            }
+        }
+
+        bool negative = false;
+        size_t i = pos;
+        if (buf[i] == '-' || buf[i] == '+') {
+            negative = (buf[i] == '-');
+            i++;
+        }
+        if (i < stop && buf[i] >= '0' && buf[i] <= '9') {
+            unsigned long long value = 0;
+            for (; i < stop && buf[i] >= '0' && buf[i] <= '9'; i++) {
+                value = value * 10 + (buf[i] - '0');
+            }
+            if (is_signed<T>::value) {
+                values.push_back((T)(negative ? -(long long)value : (long long)value));
+            } else {
+                values.push_back(negative ? 0 : (T)value);
+            }
+        }
+        pos = stop;
+    }
+    return true;
+}
+
+// Move a globally ordered, arbitrarily split array into the block distribution
+// used by every algorithm, preserving global order. Only neighbouring ranges
+// overlap, so most ranks exchange data with one or two peers.
+template <typename T>
+static void rebalanceBlocks(vector<T>& local_data, int total_n, int rank, int size, MPI_Comm comm) {
+    int local_n = local_data.size();
+    vector<int> all_counts(size);
+    MPI_Allgather(&local_n, 1, MPI_INT, all_counts.data(), 1, MPI_INT, comm);
+
+    long long my_begin = 0;
+    for (int r = 0; r < rank; ++r) my_begin += all_counts[r];
+    long long my_end = my_begin + local_n;
+
+    long long target_begin = blockOffset(total_n, size, rank);
+    long long target_end = target_begin + blockCount(total_n, size, rank);
+
+    vector<int> send_counts(size), send_displs(size), recv_counts(size), recv_displs(size);
+    long long src_begin = 0;
+    for (int r = 0; r < size; ++r) {
+        long long block_begin = blockOffset(total_n, size, r);
+        long long block_end = block_begin + blockCount(total_n, size, r);
+
+        // What I hold of rank r's block
+        long long lo = max(my_begin, block_begin), hi = min(my_end, block_end);
+        send_counts[r] = (hi > lo) ? (int)(hi - lo) : 0;
+        send_displs[r] = (hi > lo) ? (int)(lo - my_begin) : 0;
+
+        // What rank r holds of my block
+        long long src_end = src_begin + all_counts[r];
+        lo = max(src_begin, target_begin);
+        hi = min(src_end, target_end);
+        recv_counts[r] = (hi > lo) ? (int)(hi - lo) : 0;
+        recv_displs[r] = (hi > lo) ? (int)(lo - target_begin) : 0;
+        src_begin = src_end;
+    }
+
+    vector<T> block(target_end - target_begin);
+    MPI_Alltoallv(local_data.data(), send_counts.data(), send_displs.data(), mpiType<T>(),
+                  block.data(), recv_counts.data(), recv_displs.data(), mpiType<T>(), comm);
+    local_data = move(block);
+}
+
+void rebalancePartition(vector<int>& local_data, int total_n, int rank, int size, MPI_Comm comm) {
+    rebalanceBlocks(local_data, total_n, rank, size, comm);
+}
+
+// Checksum contribution of values whose first element has global index first
+template <typename T>
+static uint64_t datasetChecksum(const T* values, long long count, long long first) {
+    uint64_t sum = 0;
+    for (long long i = 0; i < count; ++i) {
+        sum += (uint64_t)(first + i + 1) * (uint64_t)(make_unsigned_t<T>)values[i];
+    }
+    return sum;
+}
+
+static bool isDatasetHeader(const DatasetHeader& header) {
+    return memcmp(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) == 0 &&
+           header.version == DATASET_VERSION;
+}
+
+// Map this rank's slice of a binary dataset and copy it into its partition.
+// The elements are already in their final layout, so there is no parsing and
+// no communication apart from the checksum reduction.
+template <typename T>
+static bool mapBinaryPartition(const char* inputFile, const DatasetHeader& header, MPI_Offset file_size,
+                               vector<T>& local_data, int& total_n, bool& presorted,
+                               int rank, int size, MPI_Comm comm) {
+    // The header is the same on every rank, so these checks agree everywhere
+    if (header.elem_type != datasetType<T>() || header.count > INT_MAX ||
+        (uint64_t)file_size < sizeof(DatasetHeader) + header.count * sizeof(T)) {
+        if (rank == 0) {
+            cerr << "Error: " << inputFile << " is not a valid "
+                 << (is_signed<T>::value ? "int32" : "uint64") << " dataset" << endl;
+        }
+        return false;
+    }
+    total_n = (int)header.count;
+    presorted = (header.flags & DATASET_SORTED) != 0;
+
+    long long first = blockOffset(total_n, size, rank);
+    int count = blockCount(total_n, size, rank);
+    local_data.clear();
+
+    int ok = 1;
+    if (count > 0) {
+        int fd = open(inputFile, O_RDONLY);
+        if (fd < 0) {
+            ok = 0;
+        } else {
+            // mmap offsets must be page aligned
+            off_t begin = sizeof(DatasetHeader) + first * sizeof(T);
+            off_t map_begin = begin & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+            size_t map_len = (begin - map_begin) + (size_t)count * sizeof(T);
+
+            void* map = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, map_begin);
+            if (map == MAP_FAILED) {
+                ok = 0;
+            } else {
+                madvise(map, map_len, MADV_SEQUENTIAL);
+                const T* slice = (const T*)((const char*)map + (begin - map_begin));
+                local_data.assign(slice, slice + count);
+                munmap(map, map_len);
+            }
+            close(fd);
+        }
+    }
+
+    uint64_t partial = datasetChecksum(local_data.data(), local_data.size(), first), checksum = 0;
+    int all_ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    MPI_Allreduce(&partial, &checksum, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (!all_ok) {
+        return false;
+    }
+    if (checksum != header.checksum) {
+        if (rank == 0) {
+            cerr << "Error: checksum mismatch in " << inputFile << endl;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Parallel input loading: every rank opens the file with MPI-IO and ends up
+// with its block of the dataset. Binary datasets are memory mapped slice by
+// slice; text files are parsed by byte range. No rank ever holds the whole
+// file. Returns false on every rank if the file can't be read.
+template <typename T>
+static bool readPartition(const char* inputFile, vector<T>& local_data, int& total_n, bool& presorted,
+                          int rank, int size, MPI_Comm comm) {
+    MPI_File fh;
+    if (MPI_File_open(comm, inputFile, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        return false;
+    }
+
+    MPI_Offset file_size = 0;
+    MPI_File_get_size(fh, &file_size);
+
+    // Rank 0 looks for a binary header and shares what it found
+    DatasetHeader header;
+    memset(&header, 0, sizeof(header));
+    int is_binary = 0;
+    if (rank == 0 && file_size >= (MPI_Offset)sizeof(DatasetHeader) &&
+        readBytes(fh, 0, (char*)&header, sizeof(header))) {
+        is_binary = isDatasetHeader(header) ? 1 : 0;
+    }
+    MPI_Bcast(&is_binary, 1, MPI_INT, 0, comm);
+
+    if (is_binary) {
+        MPI_File_close(&fh);
+        MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, comm);
+        return mapBinaryPartition(inputFile, header, file_size, local_data, total_n, presorted,
+                                  rank, size, comm);
+    }
+
+    MPI_Offset begin = file_size * rank / size;
+    MPI_Offset end = file_size * (rank + 1) / size;
+
+    local_data.clear();
+    presorted = false;
+    int ok = parseTextSlice(fh, file_size, begin, end, local_data) ? 1 : 0;
+    MPI_File_close(&fh);
+
+    int all_ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok) {
+        return false;
+    }
+
+    long long local_n = local_data.size(), global_n = 0;
+    MPI_Allreduce(&local_n, &global_n, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (global_n > INT_MAX) {
+        return false;
+    }
+    total_n = (int)global_n;
+
+    rebalanceBlocks(local_data, total_n, rank, size, comm);
+    return true;
+}
+
+bool readLocalPartition(const char* inputFile, vector<int>& local_data, int& total_n, bool& presorted,
+                        int rank, int size, MPI_Comm comm) {
+    return readPartition(inputFile, local_data, total_n, presorted, rank, size, comm);
+}
+
+bool readLocalPartition(const char* inputFile, vector<int>& local_data, int& total_n,
+                        int rank, int size, MPI_Comm comm) {
+    bool presorted = false;
+    return readPartition(inputFile, local_data, total_n, presorted, rank, size, comm);
+}
+
+// Same for a dataset of unsigned 64-bit values (text, or binary with the uint64 element type)
+bool readLocalPartition64(const char* inputFile, vector<uint64_t>& local_data, int& total_n,
+                          int rank, int size, MPI_Comm comm) {
+    bool presorted = false;
+    return readPartition(inputFile, local_data, total_n, presorted, rank, size, comm);
+}
+
+// Collective write of len bytes at offset. Every rank takes part in the same
+// number of int-sized MPI_File_write_at_all calls, even with nothing to write.
+static bool writeBytesAll(MPI_File fh, MPI_Offset offset, const char* buf, MPI_Offset len, MPI_Comm comm) {
+    long long max_len = 0, local_len = len;
+    MPI_Allreduce(&local_len, &max_len, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    bool ok = true;
+    MPI_Offset written = 0;
+    for (long long done = 0; done < max_len; done += IO_PIECE) {
+        int piece = (int)max((MPI_Offset)0, min(IO_PIECE, len - written));
+        if (MPI_File_write_at_all(fh, offset + written, buf + written, piece, MPI_CHAR,
+                                  MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+            ok = false;
+        }
+        written += piece;
+    }
+    return ok;
+}
+
+// True if a distributed array is sorted in rank order: every part is sorted
+// and the parts line up across ranks (empty parts are skipped)
+bool isGloballySorted(const int* data, int local_n, int size, MPI_Comm comm) {
+    int edges[3] = {(int)(local_n > 0), local_n > 0 ? data[0] : 0, local_n > 0 ? data[local_n - 1] : 0};
+    vector<int> all_edges(3 * size);
+    MPI_Allgather(edges, 3, MPI_INT, all_edges.data(), 3, MPI_INT, comm);
+
+    int locally_sorted = is_sorted(data, data + local_n) ? 1 : 0, sorted = 0;
+    MPI_Allreduce(&locally_sorted, &sorted, 1, MPI_INT, MPI_MIN, comm);
+
+    bool have_prev = false;
+    int prev_last = 0;
+    for (int r = 0; r < size; ++r) {
+        if (!all_edges[3 * r]) continue;
+        if (have_prev && all_edges[3 * r + 1] < prev_last) sorted = 0;
+        prev_last = all_edges[3 * r + 2];
+        have_prev = true;
+    }
+    return sorted != 0;
+}
+
+// Order-independent fingerprint of one value (splitmix64 finalizer); the sum
+// over an array identifies its multiset of values
+static uint64_t valueFingerprint(int v) {
+    uint64_t x = (uint64_t)(int64_t)v + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Check a sorted array left in memory by a run*SortDistributed function: rank
+// r must hold the elements [blockOffset(n, p, r), blockOffset(n, p, r + 1)),
+// i.e. floor(n/p) or ceil(n/p) of them, starting at global_offset; the parts
+// must be sorted in rank order; and together they must hold the values of
+// inputFile (compared by fingerprint sums). Rank 0 reports what failed.
+bool checkDistributedSort(const char* inputFile, const vector<int>& sorted_data, long long global_offset,
+                          int rank, int size, MPI_Comm comm) {
+    vector<int> input;
+    int total_n = 0;
+    if (!readLocalPartition(inputFile, input, total_n, rank, size, comm)) {
+        return false;
+    }
+
+    long long begin = blockOffset(total_n, size, rank);
+    int balanced = global_offset == begin && (long long)sorted_data.size() == blockOffset(total_n, size, rank + 1) - begin;
+    MPI_Allreduce(MPI_IN_PLACE, &balanced, 1, MPI_INT, MPI_MIN, comm);
+
+    bool sorted = isGloballySorted(sorted_data.data(), sorted_data.size(), size, comm);
+
+    uint64_t sums[2] = {0, 0};
+    for (int v : input) sums[0] += valueFingerprint(v);
+    for (int v : sorted_data) sums[1] += valueFingerprint(v);
+    MPI_Allreduce(MPI_IN_PLACE, sums, 2, MPI_UINT64_T, MPI_SUM, comm);
+    bool same_values = sums[0] == sums[1];
+
+    if (rank == 0) {
+        if (!balanced) cout << "Error: the result is not in blocks of floor(n/p) or ceil(n/p) elements\n";
+        if (!sorted) cout << "Error: the result is not in global order\n";
+        if (!same_values) cout << "Error: the result does not hold the input values\n";
+    }
+    return balanced && sorted && same_values;
+}
+
+// Write a distributed array (in rank order) as a binary dataset. Each rank
+// writes its part at the offset given by an exclusive scan of the counts;
+// rank 0 adds the header once checksum and sortedness are known.
+bool writeBinaryDataset(const char* outputFile, const int* data, int local_n,
+                        int rank, int size, MPI_Comm comm) {
+    long long count = local_n, first = 0, total = 0;
+    MPI_Exscan(&count, &first, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) first = 0;
+    MPI_Allreduce(&count, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+
+    bool sorted = isGloballySorted(data, local_n, size, comm);
+
+    uint64_t partial = datasetChecksum(data, count, first), checksum = 0;
+    MPI_Reduce(&partial, &checksum, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, outputFile, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        return false;
+    }
+    MPI_File_set_size(fh, sizeof(DatasetHeader) + total * sizeof(int));
+
+    int ok = 1;
+    if (rank == 0) {
+        DatasetHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+        header.version = DATASET_VERSION;
+        header.elem_type = DATASET_INT32;
+        header.flags = sorted ? DATASET_SORTED : 0;
+        header.count = total;
+        header.checksum = checksum;
+        ok = MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+    }
+
+    MPI_Offset offset = sizeof(DatasetHeader) + first * sizeof(int);
+    if (!writeBytesAll(fh, offset, (const char*)data, count * sizeof(int), comm)) {
+        ok = 0;
+    }
+    MPI_File_close(&fh);
+
+    int all_ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    return all_ok != 0;
+}
+
+// Output files named *.bin are written as binary datasets
+bool isBinaryOutput(const char* outputFile) {
+    size_t len = strlen(outputFile);
+    return len >= 4 && strcmp(outputFile + len - 4, ".bin") == 0;
+}
+
+// Write the text of every rank to outputFile, in rank order. Each rank finds
+// its byte offset with an exclusive scan of the text lengths, so the pieces
+// go to disk in parallel and no rank collects the others' output.
+bool writeOrderedText(const char* outputFile, const string& local_text, bool append,
+                      int rank, MPI_Comm comm) {
+    MPI_File fh;
+    if (MPI_File_open(comm, outputFile, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        return false;
+    }
+
+    MPI_Offset base = 0;
+    if (append) {
+        MPI_File_get_size(fh, &base);
+    } else {
+        MPI_File_set_size(fh, 0);
+    }
+
+    long long len = local_text.size(), offset = 0;
+    MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) offset = 0;
+
+    int ok = writeBytesAll(fh, base + offset, local_text.data(), len, comm) ? 1 : 0;
+    MPI_File_close(&fh);
+
+    int all_ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    return all_ok != 0;
+}
+
+// Write a distributed array (in rank order) to outputFile with collective
+// MPI-IO: as a binary dataset for *.bin files, otherwise as one text line
+// "<label>v0 v1 ... " that is appended to the file when append is set.
+bool writeDistributedArray(const char* outputFile, const int* data, int local_n, const char* label,
+                           bool append, int rank, int size, MPI_Comm comm) {
+    if (isBinaryOutput(outputFile)) {
+        return writeBinaryDataset(outputFile, data, local_n, rank, size, comm);
+    }
+
+    string text;
+    if (rank == 0) text = label;
+    text.reserve(text.size() + (size_t)local_n * 12 + 1);
+
+    char digits[16];
+    for (int i = 0; i < local_n; ++i) {
+        char* end = to_chars(digits, digits + sizeof(digits), data[i]).ptr;
+        *end++ = ' ';
+        text.append(digits, end);
+    }
+    if (rank == size - 1) text += '\n';
+
+    return writeOrderedText(outputFile, text, append, rank, comm);
+}
+
+// Convert a whitespace-separated text dataset to the binary container
+bool convertTextToBinary(const char* textFile, const char* binaryFile, int rank, int size, MPI_Comm comm) {
+    vector<int> local_data;
+    int total_n = 0;
+    if (!readLocalPartition(textFile, local_data, total_n, rank, size, comm)) {
+        return false;
+    }
+    return writeBinaryDataset(binaryFile, local_data.data(), local_data.size(), rank, size, comm);
+}
+
+// Serial read of the first count values of a text or binary dataset
+// (used for small inputs such as the prime search range)
+int readLeadingValues(const char* inputFile, int* values, int count) {
+    ifstream file(inputFile, ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+
+    DatasetHeader header;
+    if (file.read((char*)&header, sizeof(header)) && isDatasetHeader(header) &&
+        header.elem_type == DATASET_INT32) {
+        int n = (int)min<uint64_t>(count, header.count);
+        file.read((char*)values, n * sizeof(int));
+        return file ? n : 0;
+    }
+
+    file.clear();
+    file.seekg(0);
+    int n = 0;
+    while (n < count && file >> values[n]) {
+        n++;
+    }
+    return n;
+}
+
+// Collect the first count elements of a block-distributed array on rank 0
+// (used for the short previews written next to the results)
+vector<int> gatherPrefix(const vector<int>& local_data, int total_n, int count,
+                         int rank, int size, MPI_Comm comm) {
+    count = min(count, total_n);
+    vector<int> recv_counts(size), displs(size);
+    for (int r = 0; r < size; ++r) {
+        long long begin = blockOffset(total_n, size, r);
+        long long end = begin + blockCount(total_n, size, r);
+        recv_counts[r] = (int)max(0LL, min(end, (long long)count) - begin);
+        displs[r] = (int)min(begin, (long long)count);
+    }
+
+    vector<int> prefix(rank == 0 ? count : 0);
+    MPI_Gatherv(local_data.data(), recv_counts[rank], MPI_INT,
+                prefix.data(), recv_counts.data(), displs.data(), MPI_INT, 0, comm);
+    return prefix;
+}
+
+// Standalone converter: mpiexec -n <p> ./convert <input.txt> <output.bin>
+#ifdef PARALLEL_IO_MAIN
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    if (argc != 3) {
+        if (rank == 0) {
+            cout << "Usage: " << argv[0] << " <input.txt> <output.bin>\n";
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    bool success = convertTextToBinary(argv[1], argv[2], rank, size, MPI_COMM_WORLD);
+    if (rank == 0) {
+        cout << (success ? "Converted " : "Error: could not convert ") << argv[1] << "\n";
+    }
+
+    MPI_Finalize();
+    return success ? 0 : 1;
+}
+#endif
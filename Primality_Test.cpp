@@ -0,0 +1,165 @@
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <charconv>
+#include <iostream>
+#include <mpi.h>
+
+using namespace std;
+
+extern bool readLocalPartition64(const char* inputFile, vector<uint64_t>& local_data, int& total_n,
+                                 int rank, int size, MPI_Comm comm);
+extern bool writeOrderedText(const char* outputFile, const string& local_text, bool append,
+                             int rank, MPI_Comm comm);
+
+// Trial division by the primes below 100 settles most composites before any
+// modular exponentiation, and every n below 101^2 completely
+const int SMALL_PRIMES[25] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41,
+                              43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97};
+
+// With these bases Miller-Rabin is deterministic for every n < 2^64 (Jim Sinclair)
+const uint64_t WITNESSES[7] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+// Arithmetic modulo an odd n in Montgomery form (a is stored as a * 2^64 mod n),
+// so multiplications need no 128-bit division
+struct Montgomery
+{
+    uint64_t n, n_inv, r1, r2; // n^-1 mod 2^64, 2^64 mod n, 2^128 mod n
+
+    Montgomery(uint64_t modulus) : n(modulus)
+    {
+        n_inv = n; // Newton iteration, each step doubles the correct bits
+        for (int i = 0; i < 5; ++i)
+            n_inv *= 2 - n * n_inv;
+        r1 = (0 - n) % n;
+        r2 = (unsigned __int128)r1 * r1 % n;
+    }
+
+    // t * 2^-64 mod n for t < n * 2^64
+    uint64_t reduce(unsigned __int128 t) const
+    {
+        uint64_t m = (uint64_t)t * n_inv;
+        uint64_t mn_high = (uint64_t)(((unsigned __int128)m * n) >> 64);
+        uint64_t t_high = (uint64_t)(t >> 64);
+        return t_high >= mn_high ? t_high - mn_high : t_high - mn_high + n;
+    }
+
+    uint64_t toMontgomery(uint64_t a) const { return reduce((unsigned __int128)(a % n) * r2); }
+    uint64_t mul(uint64_t a, uint64_t b) const { return reduce((unsigned __int128)a * b); }
+
+    uint64_t pow(uint64_t base, uint64_t e) const
+    {
+        uint64_t result = r1;
+        for (; e; e >>= 1)
+        {
+            if (e & 1)
+                result = mul(result, base);
+            base = mul(base, base);
+        }
+        return result;
+    }
+};
+
+// Deterministic Miller-Rabin test for 64-bit n
+bool millerRabin(uint64_t n)
+{
+    if (n < 2)
+        return false;
+    for (int p : SMALL_PRIMES)
+    {
+        if (n % p == 0)
+            return n == (uint64_t)p;
+    }
+    if (n < 101 * 101)
+        return true;
+
+    // n - 1 = d * 2^s with d odd
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+
+    Montgomery mont(n);
+    uint64_t one = mont.r1, minus_one = n - mont.r1;
+    for (uint64_t a : WITNESSES)
+    {
+        if (a % n == 0)
+            continue;
+        uint64_t x = mont.pow(mont.toMontgomery(a), d);
+        if (x == one || x == minus_one)
+            continue;
+        bool composite = true;
+        for (int i = 1; i < s && composite; ++i)
+        {
+            x = mont.mul(x, x);
+            if (x == minus_one)
+                composite = false;
+        }
+        if (composite)
+            return false;
+    }
+    return true;
+}
+
+// Test every candidate of inputFile and write "<n> prime" or "<n> composite"
+// for each one to outputFile, in input order
+bool runPrimalityTest(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm)
+{
+    // Every process reads its own block of the candidates
+    vector<uint64_t> candidates;
+    int total_n = 0;
+    if (!readLocalPartition64(inputFile, candidates, total_n, rank, size, comm))
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Unable to read " << inputFile << "\n";
+        }
+        return false;
+    }
+
+    MPI_Barrier(comm);
+    double start_time = MPI_Wtime();
+
+    vector<char> is_prime(candidates.size());
+    long long local_primes = 0;
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        is_prime[i] = millerRabin(candidates[i]);
+        local_primes += is_prime[i];
+    }
+
+    double end_time = MPI_Wtime();
+    long long total_primes = 0;
+    MPI_Reduce(&local_primes, &total_primes, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+
+    // The blocks are in input order, so writing them in rank order keeps it
+    string text;
+    if (rank == 0)
+    {
+        text = "Primality Test Results:\nFound " + to_string(total_primes) + " primes among " +
+               to_string(total_n) + " candidates\n";
+    }
+    text.reserve(text.size() + candidates.size() * 24);
+    char digits[24];
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        text.append(digits, to_chars(digits, digits + sizeof(digits), candidates[i]).ptr);
+        text += is_prime[i] ? " prime\n" : " composite\n";
+    }
+
+    if (!writeOrderedText(outputFile, text, false, rank, comm))
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Unable to write " << outputFile << "\n";
+        }
+        return false;
+    }
+
+    double max_time = 0, local_time = end_time - start_time;
+    MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank == 0)
+    {
+        cout << "Primality Test execution time: " << max_time * 1000 << " ms\n";
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <iostream>
+#include <mpi.h>
+
+using namespace std;
+
+extern vector<int> broadcastBasePrimes(long long end, MPI_Comm comm);
+extern long long isqrt(long long n);
+extern long long countPrimes(long long start, long long end, const vector<int>& base_primes,
+                             vector<long long>& leading, int limit);
+
+// Below LMO_MIN, pi(x) is simply sieved
+const long long LMO_MIN = 1000000;
+
+// y = LMO_ALPHA * x^(1/3). A larger y shortens the sieve of [1, x/y] at the
+// cost of more special leaves; the algorithm is correct for any y with
+// x^(1/3) <= y <= x^(1/2).
+const double LMO_ALPHA = 2.0;
+
+// Integer cube root of n
+long long icbrt(long long n)
+{
+    long long r = (long long)cbrt((double)n);
+    while (r > 0 && r * r * r > n)
+        r--;
+    while ((r + 1) * (r + 1) * (r + 1) <= n)
+        r++;
+    return r;
+}
+
+// Moebius function and least prime factor of every n <= y (lpf[1] = INT_MAX,
+// so that 1 counts as having no small prime factor)
+void moebiusAndLpf(int y, vector<signed char>& mu, vector<int>& lpf)
+{
+    mu.assign(y + 1, 1);
+    lpf.assign(y + 1, 0);
+    lpf[1] = INT_MAX;
+    for (int i = 2; i <= y; ++i)
+    {
+        if (lpf[i] == 0)
+        {
+            for (long long j = i; j <= y; j += i)
+                if (lpf[j] == 0)
+                    lpf[j] = i;
+        }
+        int m = i / lpf[i];
+        mu[i] = (m > 1 && lpf[m] == lpf[i]) ? 0 : -mu[m];
+    }
+}
+
+// One segment [low, low + size) of the sieve over [1, x/y]. Every number is a
+// bit; besides the bits, a counter per block of 2^shift numbers holds how many
+// of them are still unsieved, so counting up to a position skips whole blocks.
+struct LmoSegment
+{
+    long long low;
+    int size, shift;
+    long long unsieved;
+    vector<uint64_t> bits;
+    vector<int> counters;
+
+    void reset(long long seg_low, int seg_size)
+    {
+        low = seg_low;
+        size = seg_size;
+        unsieved = size;
+        bits.assign((size + 63) / 64, ~0ULL);
+        if (size % 64)
+            bits.back() = (1ULL << (size % 64)) - 1;
+        counters.assign((size >> shift) + 1, 0);
+        for (int block = 0; block < (int)counters.size(); ++block)
+            counters[block] = max(0, min(size - (block << shift), 1 << shift));
+    }
+
+    void remove(long long i)
+    {
+        uint64_t mask = 1ULL << (i & 63);
+        if (bits[i >> 6] & mask)
+        {
+            bits[i >> 6] &= ~mask;
+            counters[i >> shift]--;
+            unsieved--;
+        }
+    }
+
+    // Remove the multiples of p (including p itself)
+    void cross(long long p)
+    {
+        for (long long i = (low + p - 1) / p * p - low; i < size; i += p)
+            remove(i);
+    }
+
+    // Number of unsieved numbers at positions [from, to)
+    long long countBits(long long from, long long to) const
+    {
+        long long count = 0;
+        while (from < to)
+        {
+            int bit = from & 63;
+            long long n = min<long long>(64 - bit, to - from);
+            uint64_t word = bits[from >> 6] >> bit;
+            if (n < 64)
+                word &= (1ULL << n) - 1;
+            count += __builtin_popcountll(word);
+            from += n;
+        }
+        return count;
+    }
+};
+
+// Counts the unsieved numbers of a segment up to increasing positions,
+// continuing from where the previous query stopped
+struct SegmentCounter
+{
+    const LmoSegment& segment;
+    long long pos = 0, count = 0;
+
+    SegmentCounter(const LmoSegment& seg) : segment(seg) {}
+
+    // Number of unsieved numbers at positions [0, idx]
+    long long upTo(long long idx)
+    {
+        long long stop = idx + 1;
+        long long block_size = 1LL << segment.shift;
+        while ((pos / block_size + 1) * block_size <= stop)
+        {
+            long long block_end = (pos / block_size + 1) * block_size;
+            if (pos % block_size == 0)
+                count += segment.counters[pos / block_size];
+            else
+                count += segment.countBits(pos, block_end);
+            pos = block_end;
+        }
+        count += segment.countBits(pos, stop);
+        pos = stop;
+        return count;
+    }
+};
+
+// pi(x) with the Lagarias-Miller-Odlyzko algorithm:
+//   pi(x) = phi(x, a) + a - 1 - P2(x, a),  a = pi(y),  phi(x, a) = S1 + S2
+// The ordinary leaves S1 are summed on process 0. The special leaves S2 and
+// P2 come from a sieve of [1, x/y] that is split into contiguous intervals,
+// one per process; the phi values a process would need from the intervals
+// before its own are added afterwards with MPI_Exscan. Returns pi(x) on every
+// process.
+long long lmoPrimePi(long long x, const vector<int>& primes, int rank, int size, MPI_Comm comm)
+{
+    if (x < LMO_MIN)
+    {
+        vector<long long> unused;
+        return countPrimes(2, x, primes, unused, 0);
+    }
+
+    long long sqrt_x = isqrt(x);
+    long long y = min(sqrt_x, max(icbrt(x), (long long)(LMO_ALPHA * icbrt(x))));
+    long long z = x / y;
+    long long sieve_limit = max(y, isqrt(z));
+
+    // primes[0 .. a-1] are the primes up to y
+    int a = upper_bound(primes.begin(), primes.end(), (int)y) - primes.begin();
+    int sieve_primes = upper_bound(primes.begin(), primes.end(), (int)sieve_limit) - primes.begin();
+    int sqrt_primes = upper_bound(primes.begin(), primes.end(), (int)sqrt_x) - primes.begin();
+
+    vector<signed char> mu;
+    vector<int> lpf;
+    moebiusAndLpf((int)y, mu, lpf);
+
+    // Ordinary leaves: sum of mu(n) * x/n over n <= y
+    long long s1 = 0;
+    if (rank == 0)
+        for (long long n = 1; n <= y; ++n)
+            s1 += mu[n] * (x / n);
+
+    // This process sieves the segments [first_seg, last_seg) of [1, z]
+    LmoSegment segment;
+    segment.shift = max(6, (int)log2((double)max(1LL, isqrt(z))) / 2 + 3);
+    long long segment_size = max(1LL << 16, 1LL << (int)ceil(log2((double)max(2LL, isqrt(z)))));
+    long long num_segments = (z + segment_size - 1) / segment_size;
+    long long first_seg = num_segments * rank / size;
+    long long last_seg = num_segments * (rank + 1) / size;
+
+    // phi_local[b]: numbers of this process's interval that are left after
+    // sieving with the first b primes (b < a); phi_local[a] counts the primes
+    // above sieve_limit. leaf_sign[b] sums -mu(m) over the leaves of prime b.
+    vector<long long> phi_local(a + 1, 0), leaf_sign(a + 1, 0);
+    long long s2 = 0, p2 = 0, p2_terms = 0;
+
+    // P2 needs pi(x/p) for the primes y < p <= sqrt(x), i.e. increasing x/p
+    // for decreasing p
+    int t = sqrt_primes - 1;
+
+    for (long long seg = first_seg; seg < last_seg; ++seg)
+    {
+        long long low = 1 + seg * segment_size;
+        long long high = min(low + segment_size, z + 1);
+        segment.reset(low, high - low);
+
+        for (int b = 0; b < a; ++b)
+        {
+            long long p = primes[b];
+
+            // Special leaves p * m with y/p < m <= y, mu(m) != 0, lpf(m) > p
+            // and x/(p*m) inside this segment
+            long long min_m = max(x / (p * high), y / p);
+            long long max_m = min(x / (p * low), y);
+            SegmentCounter counter(segment);
+            for (long long m = max_m; m > min_m; --m)
+            {
+                if (mu[m] != 0 && lpf[m] > p)
+                {
+                    long long xn = x / (p * m);
+                    s2 -= mu[m] * (phi_local[b] + counter.upTo(xn - low));
+                    leaf_sign[b] -= mu[m];
+                }
+            }
+
+            phi_local[b] += segment.unsieved;
+            segment.cross(p);
+        }
+
+        // Finish the sieve so that only primes above sieve_limit remain
+        for (int b = a; b < sieve_primes; ++b)
+            segment.cross(primes[b]);
+        if (low == 1)
+            segment.remove(0);
+
+        SegmentCounter counter(segment);
+        for (; t >= a && x / primes[t] < high; --t)
+        {
+            long long v = x / primes[t];
+            if (v < low)
+                continue;
+            p2 += phi_local[a] + counter.upTo(v - low);
+            p2_terms++;
+        }
+        phi_local[a] += segment.unsieved;
+    }
+
+    // Add what the intervals of the lower ranks contribute to each count
+    vector<long long> phi_before(a + 1, 0);
+    MPI_Exscan(phi_local.data(), phi_before.data(), a + 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0)
+        fill(phi_before.begin(), phi_before.end(), 0);
+
+    for (int b = 0; b < a; ++b)
+        s2 += leaf_sign[b] * phi_before[b];
+    p2 += p2_terms * (sieve_primes + phi_before[a]);
+
+    // P2 = sum over y < p <= sqrt(x) of pi(x/p) - pi(p) + 1
+    if (rank == 0)
+        for (int i = a; i < sqrt_primes; ++i)
+            p2 -= i;
+
+    long long local = s1 + s2 - p2, total = 0;
+    MPI_Allreduce(&local, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    return total + a - 1;
+}
+
+// Number of primes in [start, end] without enumerating them
+void parallelPrimeCount(long long start, long long end)
+{
+    double start_time = MPI_Wtime();
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Process 0 computes the primes up to sqrt(end) once and broadcasts them
+    vector<int> primes = broadcastBasePrimes(end, MPI_COMM_WORLD);
+
+    long long count = 0;
+    if (end >= 2 && start <= end)
+    {
+        count = lmoPrimePi(end, primes, rank, size, MPI_COMM_WORLD);
+        if (start > 2)
+            count -= lmoPrimePi(start - 1, primes, rank, size, MPI_COMM_WORLD);
+    }
+
+    if (rank == 0)
+    {
+        double end_time = MPI_Wtime();
+        cout << "Execution time: " << (end_time - start_time) * 1000 << " ms\n";
+
+        FILE *out = fopen("out.txt", "w");
+        fprintf(out, "Prime Counting Results:\n");
+        fprintf(out, "Found %lld primes between %lld and %lld\n", count, start, end);
+        fclose(out);
+    }
+}
\ No newline at end of file
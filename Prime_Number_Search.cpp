@@ -1,30 +1,344 @@
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <string>
 #include <iostream>
 #include <mpi.h>
 
 using namespace std;
 
-bool isPrime(int n)
+extern void parallelPrimeCount(long long start, long long end);
+
+// Numbers are stored on a mod-30 wheel: of every 30 consecutive integers only
+// the 8 that are coprime to 2, 3 and 5 can be prime, so one byte holds 30
+// numbers. A segment of SEGMENT_BYTES therefore covers about 1M numbers while
+// staying small enough to be sieved in cache.
+const int SEGMENT_BYTES = 32 * 1024;
+
+// The residues modulo 30 that are coprime to 30 (bit k of a byte is WHEEL[k])
+const int WHEEL[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+// Distance from each residue to the next one on the wheel
+const int WHEEL_GAP[8] = {6, 4, 2, 4, 2, 4, 6, 2};
+// Bit of each residue modulo 30, or -1 for multiples of 2, 3 or 5
+const signed char WHEEL_BIT[30] = {-1, 0, -1, -1, -1, -1, -1, 1, -1, -1,
+                                   -1, 2, -1, 3, -1, -1, -1, 4, -1, 5,
+                                   -1, -1, -1, 6, -1, -1, -1, -1, -1, 7};
+
+// Largest supported bound: keeps sqrt(end) within int and p*q below 2^63
+const long long MAX_PRIME_BOUND = 4000000000000000000LL;
+
+// Output modes of parallelPrimeSearch
+const int PRIME_COUNT = 0; // count the primes and preview the first ones
+const int PRIME_LIST = 1;  // additionally write every prime to PRIME_LIST_FILE
+const int PRIME_PI = 2;    // only count, with the LMO algorithm (Prime_Counting.cpp)
+
+// All primes of a PRIME_LIST search, stored as LEB128 varints of the gaps
+// between consecutive primes (the first gap is measured from 0)
+const char* PRIME_LIST_FILE = "primes.bin";
+
+struct PrimeListHeader
+{
+    char magic[4];      // "PSPG"
+    uint32_t version;   // 1
+    uint64_t count;     // number of primes
+    int64_t start, end; // searched range
+};
+
+// Map the mode token of in.txt ("count", "list" or "pi") to an output mode
+int primeOutputMode(const string& name)
+{
+    if (name == "list")
+        return PRIME_LIST;
+    if (name == "pi")
+        return PRIME_PI;
+    return PRIME_COUNT;
+}
+
+// Integer square root of n
+long long isqrt(long long n)
+{
+    long long r = (long long)sqrt((double)n);
+    while (r > 0 && r * r > n)
+        r--;
+    while ((r + 1) * (r + 1) <= n)
+        r++;
+    return r;
+}
+
+// Sieve one segment of bytes * 30 numbers starting at seg_lo (a multiple of
+// 30): afterwards bit k of segment[i] is set iff seg_lo + 30 * i + WHEEL[k]
+// is prime. base_primes must contain every prime up to the square root of
+// the end of the segment.
+void sieveSegment(long long seg_lo, int bytes, const vector<int>& base_primes, vector<unsigned char>& segment)
+{
+    long long seg_hi = seg_lo + 30LL * bytes;
+    fill(segment.begin(), segment.begin() + bytes, 0xFF);
+    if (seg_lo == 0)
+        segment[0] &= ~1; // 1 is not prime
+
+    for (int p : base_primes)
+    {
+        if (p < 7)
+            continue;
+        if ((long long)p * p >= seg_hi)
+            break;
+
+        // First multiple p*q inside the segment with q >= p and q on the wheel
+        long long q = max<long long>(p, (seg_lo + p - 1) / p);
+        while (WHEEL_BIT[q % 30] < 0)
+            q++;
+        int j = WHEEL_BIT[q % 30];
+
+        // Walk q around the wheel so that only multiples coprime to 30 are visited
+        for (long long off = p * q - seg_lo; off < seg_hi - seg_lo; off += (long long)p * WHEEL_GAP[j], j = (j + 1) & 7)
+            segment[off / 30] &= ~(1 << WHEEL_BIT[off % 30]);
+    }
+}
+
+// Segmented Sieve of Eratosthenes on [start, end]: calls visit(p) for every
+// prime in increasing order
+template <typename Visit>
+void forEachPrime(long long start, long long end, const vector<int>& base_primes, Visit visit)
+{
+    if (start < 2)
+        start = 2;
+    if (start > end)
+        return;
+
+    // 2, 3 and 5 are not on the wheel
+    for (int p : {2, 3, 5})
+        if (p >= start && p <= end)
+            visit((long long)p);
+
+    vector<unsigned char> segment(SEGMENT_BYTES);
+    for (long long seg_lo = start / 30 * 30; seg_lo <= end; seg_lo += 30LL * SEGMENT_BYTES)
+    {
+        int bytes = (int)min<long long>(SEGMENT_BYTES, (end - seg_lo) / 30 + 1);
+        sieveSegment(seg_lo, bytes, base_primes, segment);
+
+        for (int i = 0; i < bytes; ++i)
+        {
+            for (unsigned bits = segment[i]; bits; bits &= bits - 1)
+            {
+                long long n = seg_lo + 30LL * i + WHEEL[__builtin_ctz(bits)];
+                if (n >= start && n <= end)
+                    visit(n);
+            }
+        }
+    }
+}
+
+// Simple sieve for the primes up to limit
+vector<int> smallPrimes(int limit)
 {
-    if (n <= 1)
-        return false;
-    for (int i = 2; i * i <= n; ++i)
-        if (n % i == 0)
-            return false;
-    return true;
+    vector<int> primes;
+    if (limit < 2)
+        return primes;
+    vector<bool> composite(limit + 1, false);
+    for (int i = 2; i <= limit; ++i)
+    {
+        if (composite[i])
+            continue;
+        primes.push_back(i);
+        for (long long j = (long long)i * i; j <= limit; j += i)
+            composite[j] = true;
+    }
+    return primes;
 }
 
-vector<int> findPrimes(int start, int end)
+// The base primes of the segmented sieve (every prime up to limit); for
+// large bounds they are sieved in segments themselves
+vector<int> basePrimes(int limit)
 {
     vector<int> primes;
-    for (int i = start; i <= end; ++i)
-        if (isPrime(i))
-            primes.push_back(i);
+    forEachPrime(2, limit, smallPrimes((int)isqrt(limit)), [&](long long p) { primes.push_back((int)p); });
+    return primes;
+}
+
+// The base primes for sieving or counting up to end: process 0 computes them
+// once and broadcasts them to every process of comm
+vector<int> broadcastBasePrimes(long long end, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    vector<int> primes;
+    int count = 0;
+    if (rank == 0)
+    {
+        primes = basePrimes((int)isqrt(max(end, 0LL)));
+        count = primes.size();
+    }
+    MPI_Bcast(&count, 1, MPI_INT, 0, comm);
+    primes.resize(count);
+    MPI_Bcast(primes.data(), count, MPI_INT, 0, comm);
     return primes;
 }
 
-void parallelPrimeSearch(int start, int end)
+// Number of primes in [start, end]; whole bytes are counted with popcount,
+// only the bytes at the two ends of the range are checked bit by bit. The
+// smallest primes are also appended to leading until it holds limit primes.
+long long countPrimes(long long start, long long end, const vector<int>& base_primes,
+                      vector<long long>& leading, int limit)
+{
+    if (start < 2)
+        start = 2;
+    if (start > end)
+        return 0;
+
+    long long count = 0;
+    for (int p : {2, 3, 5})
+    {
+        if (p >= start && p <= end)
+        {
+            count++;
+            if ((int)leading.size() < limit)
+                leading.push_back(p);
+        }
+    }
+
+    vector<unsigned char> segment(SEGMENT_BYTES);
+    for (long long seg_lo = start / 30 * 30; seg_lo <= end; seg_lo += 30LL * SEGMENT_BYTES)
+    {
+        int bytes = (int)min<long long>(SEGMENT_BYTES, (end - seg_lo) / 30 + 1);
+        sieveSegment(seg_lo, bytes, base_primes, segment);
+
+        for (int i = 0; i < bytes; ++i)
+        {
+            long long group = seg_lo + 30LL * i;
+            if (group >= start && group + 29 <= end && (int)leading.size() >= limit)
+            {
+                count += __builtin_popcount(segment[i]);
+                continue;
+            }
+            for (unsigned bits = segment[i]; bits; bits &= bits - 1)
+            {
+                long long n = group + WHEEL[__builtin_ctz(bits)];
+                if (n >= start && n <= end)
+                {
+                    count++;
+                    if ((int)leading.size() < limit)
+                        leading.push_back(n);
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Append n to out as an unsigned LEB128 varint
+void appendVarint(vector<unsigned char>& out, unsigned long long n)
+{
+    while (n >= 0x80)
+    {
+        out.push_back((unsigned char)(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back((unsigned char)n);
+}
+
+int varintLength(unsigned long long n)
+{
+    int len = 1;
+    while (n >= 0x80)
+    {
+        n >>= 7;
+        len++;
+    }
+    return len;
+}
+
+// Work is handed out in chunks: about CHUNKS_PER_PROCESS chunks per process so
+// the last ones can even out the load, and at most MAX_CHUNK_SEGMENTS sieve
+// segments each so the per-chunk bookkeeping stays small for huge ranges.
+// Every chunk walks over all base primes, so a chunk is never narrower than
+// sqrt(end) either.
+const int CHUNKS_PER_PROCESS = 8;
+const int MAX_CHUNK_SEGMENTS = 64;
+
+long long primeChunkSize(long long range, long long end, int size)
+{
+    long long chunk = range / ((long long)size * CHUNKS_PER_PROCESS);
+    chunk = min(chunk, 30LL * SEGMENT_BYTES * MAX_CHUNK_SEGMENTS);
+    return max({30LL, chunk, isqrt(max(end, 0LL))});
+}
+
+// out.txt lists all primes when there are at most PREVIEW_PRIMES of them,
+// otherwise only the first 10
+const int PREVIEW_PRIMES = 100;
+
+// In list mode the chunks are written in batches of LIST_BATCH_CHUNKS chunks
+// per process: as soon as every chunk of a batch is sieved, the processes
+// agree on the batch's file offsets, write their chunks and free them. A
+// process therefore holds the primes of at most one batch, not of its whole
+// share of the range.
+const int LIST_BATCH_CHUNKS = 2;
+
+// Longest LEB128 encoding of a 64-bit value
+const int MAX_VARINT_BYTES = 10;
+
+// Encoded primes of one chunk: the gaps after its first prime are encoded
+// while sieving, behind MAX_VARINT_BYTES reserved bytes that take the gap in
+// front of the first prime once the last prime of the preceding chunks is known
+struct PrimeChunk
+{
+    int index;
+    long long first, last, count;
+    vector<unsigned char> gaps;
+};
+
+// Write the chunks [batch_lo, batch_hi) of a PRIME_LIST search to fh and free
+// them. Every process writes its own chunks; one MPI_Allreduce of the first
+// prime, last prime and encoded size of every chunk of the batch gives all
+// processes the offsets. previous (the last prime before the batch) and
+// offset (where the batch starts in the file) are advanced past the batch.
+void writePrimeBatch(MPI_File fh, vector<PrimeChunk>& chunks, int batch_lo, int batch_hi,
+                     long long& previous, long long& offset, MPI_Comm comm)
+{
+    // Every chunk is filled in by the process that sieved it and zero elsewhere
+    int batch = batch_hi - batch_lo;
+    vector<long long> info(3 * batch, 0);
+    for (const PrimeChunk& c : chunks)
+    {
+        if (c.count == 0)
+            continue;
+        long long* entry = &info[3 * (c.index - batch_lo)];
+        entry[0] = c.first;
+        entry[1] = c.last;
+        entry[2] = c.gaps.size() - MAX_VARINT_BYTES;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, info.data(), 3 * batch, MPI_LONG_LONG, MPI_SUM, comm);
+
+    vector<long long> chunk_previous(batch), chunk_offset(batch);
+    for (int k = 0; k < batch; ++k)
+    {
+        chunk_previous[k] = previous;
+        chunk_offset[k] = offset;
+        if (info[3 * k] == 0) // no primes in the chunk
+            continue;
+        offset += varintLength(info[3 * k] - previous) + info[3 * k + 2];
+        previous = info[3 * k + 1];
+    }
+
+    vector<unsigned char> first_gap;
+    for (PrimeChunk& c : chunks)
+    {
+        if (c.count == 0)
+            continue;
+        int k = c.index - batch_lo;
+        first_gap.clear();
+        appendVarint(first_gap, c.first - chunk_previous[k]);
+        unsigned char* data = c.gaps.data() + MAX_VARINT_BYTES - first_gap.size();
+        copy(first_gap.begin(), first_gap.end(), data);
+        MPI_File_write_at(fh, chunk_offset[k], data, c.gaps.data() + c.gaps.size() - data, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    chunks.clear();
+}
+
+void parallelPrimeSearch(long long start, long long end, int mode)
 {
     double start_time, end_time;
     start_time = MPI_Wtime();
@@ -33,45 +347,175 @@ void parallelPrimeSearch(int start, int end)
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    int range = end - start + 1;
-    int chunk = range / size;
-    int remainder = range % size;
-    int local_start = start + rank * chunk + (rank < remainder ? rank : remainder);
-    int local_end = local_start + chunk - 1 + (rank < remainder ? 1 : 0);
+    if (end > MAX_PRIME_BOUND)
+    {
+        if (rank == 0)
+            cout << "Error: the upper bound must not exceed " << MAX_PRIME_BOUND << "\n";
+        return;
+    }
+    // Counting alone does not need to sieve the whole range
+    if (mode == PRIME_PI)
+    {
+        parallelPrimeCount(start, end);
+        return;
+    }
+
+    long long requested_start = start;
+    start = max(start, 0LL);
 
-    vector<int> local_primes = findPrimes(local_start, local_end);
-    int local_count = local_primes.size();
+    // Process 0 computes the primes up to sqrt(end) once and broadcasts them
+    vector<int> base_primes = broadcastBasePrimes(end, MPI_COMM_WORLD);
 
-    vector<int> counts(size);
-    MPI_Gather(&local_count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // The range is cut into chunks that the processes claim one at a time
+    long long range = max(0LL, end - start + 1);
+    long long chunk_size = primeChunkSize(range, end, size);
+    int num_chunks = (int)((range + chunk_size - 1) / chunk_size);
 
-    vector<int> displs(size);
-    int total = 0;
+    // In list mode the file is written batch by batch while sieving
+    MPI_File list_file;
+    if (mode == PRIME_LIST &&
+        MPI_File_open(MPI_COMM_WORLD, PRIME_LIST_FILE, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &list_file) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+            cout << "Error: Unable to write " << PRIME_LIST_FILE << "\n";
+        return;
+    }
+    int batch_chunks = mode == PRIME_LIST ? LIST_BATCH_CHUNKS * size : max(num_chunks, 1);
+    long long list_previous = 0, list_bytes = sizeof(PrimeListHeader);
+
+    // Shared chunk counter, stored in a window on process 0
+    int *next_chunk;
+    MPI_Win win;
+    MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &next_chunk, &win);
     if (rank == 0)
     {
-        for (int i = 0; i < size; ++i)
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, win);
+        *next_chunk = 0;
+        MPI_Win_unlock(0, win);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    long long local_count = 0;
+    vector<long long> leading; // the smallest primes found by this process
+    vector<PrimeChunk> chunks;
+    double busy_time = 0;
+    int local_chunks = 0;
+    const int one = 1;
+
+    // Claim the next unprocessed chunk
+    auto claim = [&]() {
+        int c;
+        MPI_Fetch_and_op(&one, &c, MPI_INT, 0, 0, MPI_SUM, win);
+        MPI_Win_flush(0, win);
+        return c;
+    };
+
+    MPI_Win_lock_all(0, win);
+    int c = claim();
+    for (int batch_lo = 0; batch_lo < num_chunks; batch_lo += batch_chunks)
+    {
+        // Chunks are claimed in increasing order: once this process holds a
+        // chunk beyond the batch, every chunk of the batch has been claimed
+        int batch_hi = min(num_chunks, batch_lo + batch_chunks);
+        while (c < batch_hi)
         {
-            displs[i] = total;
-            total += counts[i];
+            double chunk_start = MPI_Wtime();
+            long long lo = start + c * chunk_size;
+            long long hi = min(end, lo + chunk_size - 1);
+            if (mode == PRIME_LIST)
+            {
+                PrimeChunk chunk = {c, 0, 0, 0, vector<unsigned char>(MAX_VARINT_BYTES)};
+                forEachPrime(lo, hi, base_primes, [&](long long p) {
+                    if ((int)leading.size() < PREVIEW_PRIMES)
+                        leading.push_back(p);
+                    if (chunk.count == 0)
+                        chunk.first = p;
+                    else
+                        appendVarint(chunk.gaps, p - chunk.last);
+                    chunk.last = p;
+                    chunk.count++;
+                });
+                local_count += chunk.count;
+                chunks.push_back(move(chunk));
+            }
+            else
+            {
+                local_count += countPrimes(lo, hi, base_primes, leading, PREVIEW_PRIMES);
+            }
+            busy_time += MPI_Wtime() - chunk_start;
+            local_chunks++;
+            c = claim();
         }
+
+        if (mode == PRIME_LIST)
+            writePrimeBatch(list_file, chunks, batch_lo, batch_hi, list_previous, list_bytes, MPI_COMM_WORLD);
     }
+    MPI_Win_unlock_all(win);
+
+    // Idle time: how long this process waits for the slowest one
+    double idle_start = MPI_Wtime();
+    MPI_Barrier(MPI_COMM_WORLD);
+    double idle_time = MPI_Wtime() - idle_start;
+    MPI_Win_free(&win);
 
-    vector<int> all_primes(total);
-    MPI_Gatherv(local_primes.data(), local_count, MPI_INT, all_primes.data(), counts.data(), displs.data(), MPI_INT, 0, MPI_COMM_WORLD);
+    // Only the counts travel to process 0; the primes themselves stay where they were found
+    long long total = 0;
+    MPI_Allreduce(&local_count, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    // Chunks are claimed in increasing order, so each process's first primes
+    // are its smallest; the global first primes are among them
+    leading.resize(PREVIEW_PRIMES, LLONG_MAX);
+    vector<long long> all_leading(rank == 0 ? PREVIEW_PRIMES * size : 0);
+    MPI_Gather(leading.data(), PREVIEW_PRIMES, MPI_LONG_LONG, all_leading.data(), PREVIEW_PRIMES, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    // The header needs the total; the size drops what an older file had beyond the list
+    if (mode == PRIME_LIST)
+    {
+        MPI_File_set_size(list_file, list_bytes);
+        if (rank == 0)
+        {
+            PrimeListHeader header = {{'P', 'S', 'P', 'G'}, 1, (uint64_t)total, start, end};
+            MPI_File_write_at(list_file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+        MPI_File_close(&list_file);
+    }
+
+    // Per-process load report
+    double times[2] = {busy_time, idle_time};
+    vector<double> all_times(2 * size);
+    vector<int> all_chunks(size);
+    MPI_Gather(times, 2, MPI_DOUBLE, all_times.data(), 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(&local_chunks, 1, MPI_INT, all_chunks.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
 
     if (rank == 0)
     {
         end_time = MPI_Wtime();
 
         cout << "Execution time: " << (end_time - start_time) * 1000 << " ms\n";
-        
+
+        double max_busy = 0, sum_busy = 0;
+        for (int i = 0; i < size; ++i)
+        {
+            cout << "Process " << i << ": busy " << all_times[2 * i] * 1000 << " ms, idle "
+                 << all_times[2 * i + 1] * 1000 << " ms, " << all_chunks[i] << " chunks\n";
+            max_busy = max(max_busy, all_times[2 * i]);
+            sum_busy += all_times[2 * i];
+        }
+        if (sum_busy > 0)
+            cout << "Load imbalance (max/avg busy time): " << max_busy * size / sum_busy << "\n";
+
+        sort(all_leading.begin(), all_leading.end());
+        all_leading.resize(total > PREVIEW_PRIMES ? 10 : total);
+
         FILE *out = fopen("out.txt", "w");
         fprintf(out, "Prime Number Search Results:\n");
-        fprintf(out, "Found %d primes between %d and %d\n", total, start, end);
-        for (int i = 0; i < (total > 100 ? 10 : total); ++i)
-            fprintf(out, "%d ", all_primes[i]);
-        if (total > 100)
-            fprintf(out, "... (and %d more)", total - 10);
+        fprintf(out, "Found %lld primes between %lld and %lld\n", total, requested_start, end);
+        for (long long p : all_leading)
+            fprintf(out, "%lld ", p);
+        if (total > PREVIEW_PRIMES)
+            fprintf(out, "... (and %lld more)", total - 10);
+        if (mode == PRIME_LIST)
+            fprintf(out, "\nAll primes written to %s (%lld bytes)", PRIME_LIST_FILE, list_bytes);
         fclose(out);
     }
-}
\ No newline at end of file
+}
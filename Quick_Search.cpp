@@ -4,147 +4,806 @@
 #include <algorithm>
 #include <mpi.h>
 #include <sstream>
+#include <string>
+#include <climits>
+#include <cmath>
 
 using namespace std;
 
+extern bool readLocalPartition(const char* inputFile, vector<int>& local_data, int& total_n, bool& presorted, int rank, int size, MPI_Comm comm);
+extern bool sample_sort_buckets(vector<int>& local_data, int array_size, int rank, int size, MPI_Comm comm);
+
+// Queries of a session are routed and answered in blocks of this size
+const int QUERY_BLOCK = 4096;
+
+// Without an index, queries are answered by scanning the unsorted partition:
+// SCAN_BLOCK queries at a time over chunks of SCAN_CHUNK elements, so that a
+// chunk is read from memory once per block and stays in the L1 cache
+const int SCAN_BLOCK = 64;
+const int SCAN_CHUNK = 8192;
+
+// Cost model that decides between scanning and indexing, in nanoseconds per
+// element of a process's partition, except LOOKUP_NS, which is per query
+// (measured on the development machine)
+const double SCAN_NS = 0.17;    // one vectorized pass for one query
+const double SORT_NS = 6.0;     // Sample Sort, per element and level log2(n/p)
+const double EXCHANGE_NS = 20;  // redistribution by value range and merging
+const double LOOKUP_NS = 150;   // routing one query to its owner and searching there
+
+// Messages between process 0 and the owners of the queries
+const int QUERY_TAG = 1;
+const int ANSWER_TAG = 2;
+const int DONE_TAG = 3;
+const int LOWER_TAG = 4;
+const int LIST_TAG = 5;
+
+// Layouts of the local index that a process searches (see LocalIndex)
+const int LAYOUT_SORTED = 0;    // binary search over the sorted range itself
+const int LAYOUT_EYTZINGER = 1; // keys in BFS order of a binary tree, with prefetching
+const int LAYOUT_STREE = 2;     // static B-tree of 16-key nodes searched with SIMD
+
+// Map a layout name ("sorted", "eytzinger" or "stree") to a layout
+int quickSearchLayout(const string& name) {
+    if (name == "eytzinger") {
+        return LAYOUT_EYTZINGER;
+    }
+    if (name == "stree") {
+        return LAYOUT_STREE;
+    }
+    return LAYOUT_SORTED;
+}
+
+const char* layoutName(int layout) {
+    return layout == LAYOUT_EYTZINGER ? "eytzinger" : layout == LAYOUT_STREE ? "stree" : "sorted";
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define QUICK_SEARCH_SIMD 1
+#endif
+
+// Keys per S-tree node: one 64-byte cache line
+const int STREE_B = 16;
+
+struct alignas(64) CacheLine {
+    int v[STREE_B];
+};
+
+// Number of keys of an S-tree node that are smaller than target
+static inline int nodeRank(const int* node, int target) {
+    int rank = 0;
+    for (int i = 0; i < STREE_B; i++) {
+        rank += node[i] < target;
+    }
+    return rank;
+}
+
+// A read-only search structure over one process's sorted range, built once
+// after the range is known. Every layout answers the same question: the
+// sorted position of the first key that is not smaller than a target.
+//
+// A binary search over the sorted array misses the cache at nearly every
+// level once the range is large. The Eytzinger layout stores the keys in the
+// BFS order of a binary search tree, so the next levels of a search lie close
+// together and can be prefetched. The S-tree stores 16 keys per node in one
+// cache line with 17 children per node, so a search touches log_17(n) lines
+// and ranks the target within a node with two vector compares. Both keep a
+// positions array parallel to their keys, giving the sorted position of a key.
+class LocalIndex {
+private:
+    int layout;
+    int n;
+    const vector<int>* sorted;
+
+    // Eytzinger: keys eytzinger[1 .. n]; the keys of node k are eytzinger[16k ..
+    // 16k + 15] four levels down, which is one aligned cache line
+    vector<CacheLine> eytzinger_lines;
+    int* eytzinger;
+
+    // S-tree: node k holds keys stree[k].v, and child i of node k is node
+    // k * (STREE_B + 1) + i + 1. Slots past the last key hold INT_MAX.
+    vector<CacheLine> stree;
+    int stree_nodes;
+
+    vector<int> positions;
+
+    // Fills the subtree of node k with the keys from position i in order
+    int buildEytzinger(int i, int k) {
+        if (k <= n) {
+            i = buildEytzinger(i, 2 * k);
+            eytzinger[k] = (*sorted)[i];
+            positions[k] = i;
+            i = buildEytzinger(i + 1, 2 * k + 1);
+        }
+        return i;
+    }
+
+    int buildSTree(int i, int k) {
+        if (k < stree_nodes) {
+            for (int j = 0; j < STREE_B; j++) {
+                i = buildSTree(i, k * (STREE_B + 1) + j + 1);
+                stree[k].v[j] = i < n ? (*sorted)[i] : INT_MAX;
+                positions[k * STREE_B + j] = i < n ? i : n;
+                i = min(i + 1, n);
+            }
+            i = buildSTree(i, k * (STREE_B + 1) + STREE_B + 1);
+        }
+        return i;
+    }
+
+    int searchSorted(int target, int& key) const {
+        const vector<int>& arr = *sorted;
+        int left = 0, right = n;
+        while (left < right) {
+            int mid = left + (right - left) / 2;
+            if (arr[mid] < target) {
+                left = mid + 1;
+            }
+            else {
+                right = mid;
+            }
+        }
+        if (left < n) {
+            key = arr[left];
+        }
+        return left;
+    }
+
+    // Branch-free descent: going left or right is a comparison result, and the
+    // cache line four levels down is prefetched on the way. The last node
+    // where the search went left holds the answer; the trailing ones of k say
+    // how many levels ago that was. Prefetching past the end is harmless.
+    int searchEytzinger(int target, int& key) const {
+        int k = 1;
+        while (k <= n) {
+            __builtin_prefetch(eytzinger + 16 * k);
+            k = 2 * k + (eytzinger[k] < target);
+        }
+        k >>= __builtin_ffs(~k);
+        if (k == 0) {
+            return n;
+        }
+        key = eytzinger[k];
+        return positions[k];
+    }
+
+    // The answer is the first key not smaller than target in the last node
+    // where the search found one
+    int searchSTreeScalar(int target, int& key) const {
+        int result = n;
+        for (int k = 0; k < stree_nodes;) {
+            int i = nodeRank(stree[k].v, target);
+            if (i < STREE_B) {
+                key = stree[k].v[i];
+                result = positions[k * STREE_B + i];
+            }
+            k = k * (STREE_B + 1) + i + 1;
+        }
+        return result;
+    }
+
+#ifdef QUICK_SEARCH_SIMD
+    __attribute__((target("avx2,popcnt")))
+    int searchSTreeAvx2(int target, int& key) const {
+        __m256i x = _mm256_set1_epi32(target);
+        int result = n;
+        for (int k = 0; k < stree_nodes;) {
+            const __m256i* node = (const __m256i*)stree[k].v;
+            __m256i lo = _mm256_cmpgt_epi32(x, _mm256_load_si256(node));
+            __m256i hi = _mm256_cmpgt_epi32(x, _mm256_load_si256(node + 1));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(lo)) |
+                       (_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+            int i = __builtin_popcount(mask);
+            if (i < STREE_B) {
+                key = stree[k].v[i];
+                result = positions[k * STREE_B + i];
+            }
+            k = k * (STREE_B + 1) + i + 1;
+        }
+        return result;
+    }
+#endif
+
+    // Sorted position of the first key not smaller than target (n if there
+    // is none); key receives that key
+    int search(int target, int& key) const {
+        if (layout == LAYOUT_EYTZINGER) {
+            return searchEytzinger(target, key);
+        }
+        if (layout == LAYOUT_STREE) {
+#ifdef QUICK_SEARCH_SIMD
+            static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+            if (avx2) {
+                return searchSTreeAvx2(target, key);
+            }
+#endif
+            return searchSTreeScalar(target, key);
+        }
+        return searchSorted(target, key);
+    }
+
+public:
+    LocalIndex() : layout(LAYOUT_SORTED), n(0), sorted(nullptr), eytzinger(nullptr), stree_nodes(0) {}
+
+    // Builds the index over a sorted array, which must outlive the index
+    void build(const vector<int>& sorted_data, int index_layout) {
+        layout = index_layout;
+        sorted = &sorted_data;
+        n = sorted_data.size();
+        eytzinger_lines.clear();
+        stree.clear();
+        positions.clear();
+
+        if (layout == LAYOUT_EYTZINGER) {
+            eytzinger_lines.resize((n + 1) / STREE_B + 1);
+            eytzinger = eytzinger_lines.data()->v;
+            positions.resize(n + 1);
+            buildEytzinger(0, 1);
+        }
+        else if (layout == LAYOUT_STREE) {
+            stree_nodes = (n + STREE_B - 1) / STREE_B;
+            stree.resize(stree_nodes);
+            positions.resize(stree_nodes * STREE_B);
+            buildSTree(0, 0);
+        }
+    }
+
+    int size() const {
+        return n;
+    }
+
+    int lowerBound(int target) const {
+        int key;
+        return search(target, key);
+    }
+
+    // Sorted position of the first occurrence of target, or -1
+    int find(int target) const {
+        int key = 0;
+        int pos = search(target, key);
+        return (pos < n && key == target) ? pos : -1;
+    }
+};
+
+// Number of elements of data[0 .. n) below a and above b
+static void scanCounts(const int* data, int n, int a, int b, int& below, int& above) {
+    int lt = 0, gt = 0;
+    for (int i = 0; i < n; i++) {
+        lt += data[i] < a;
+        gt += data[i] > b;
+    }
+    below += lt;
+    above += gt;
+}
+
+#ifdef QUICK_SEARCH_SIMD
+// A comparison lane is -1 where it holds, so subtracting it counts. Every lane
+// counts at most n / 8 elements, far from overflowing for n <= SCAN_CHUNK.
+__attribute__((target("avx2")))
+static void scanCountsAvx2(const int* data, int n, int a, int b, int& below, int& above) {
+    __m256i av = _mm256_set1_epi32(a), bv = _mm256_set1_epi32(b);
+    __m256i lt = _mm256_setzero_si256(), gt = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+        lt = _mm256_sub_epi32(lt, _mm256_cmpgt_epi32(av, x));
+        gt = _mm256_sub_epi32(gt, _mm256_cmpgt_epi32(x, bv));
+    }
+    alignas(32) int lanes[16];
+    _mm256_store_si256((__m256i*)lanes, lt);
+    _mm256_store_si256((__m256i*)(lanes + 8), gt);
+    for (int j = 0; j < 8; j++) {
+        below += lanes[j];
+        above += lanes[8 + j];
+    }
+    scanCounts(data + i, n - i, a, b, below, above);
+}
+#endif
+
+// Scans one chunk of a partition for a range query [a, b]
+static void scanChunk(const int* data, int n, int a, int b, int& below, int& above) {
+#ifdef QUICK_SEARCH_SIMD
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        scanCountsAvx2(data, n, a, b, below, above);
+        return;
+    }
+#endif
+    scanCounts(data, n, a, b, below, above);
+}
+
+// True if answering queries lookups by scanning every partition is expected
+// to be cheaper than sorting, redistributing and indexing the dataset first.
+// A scan costs a pass over n/p elements per query; the index costs a sort
+// and an exchange once (nothing for a presorted dataset) and then a routed
+// lookup per query.
+bool scanIsCheaper(long long total_n, int size, long long queries, bool presorted) {
+    double m = max(1.0, (double)total_n / size);
+    double scan = queries * m * SCAN_NS;
+    double build = presorted ? 0 : m * (SORT_NS * log2(m + 1) + EXCHANGE_NS);
+    return scan < build + queries * LOOKUP_NS;
+}
+
 class ParallelQuickSearch {
 private:
-    vector<int> global_dataset;
     vector<int> local_dataset;
+    int total_elements;
+    bool presorted;
     int rank;
     int num_processes;
     MPI_Comm comm;
 
-    int partition(vector<int>& arr, int low, int high) {
-        if (low >= high) return low;
+    // Splitter table, the same on every process: the non-empty ranks in order,
+    // with their smallest and largest value and the global position of their
+    // first element
+    vector<int> owner_rank, owner_min, owner_max, owner_offset;
+    int local_offset;
+
+    // Search structure over local_dataset; without it local_dataset is the
+    // unsorted input block and queries are answered by scanBatch
+    bool indexed;
+    LocalIndex index;
+
+    bool readDatasetFromFile(const string& filename) {
+        // Every process reads its own partition straight from the file
+        if (!readLocalPartition(filename.c_str(), local_dataset, total_elements, presorted, rank, num_processes, comm)) {
+            return false;
+        }
+        return total_elements > 0;
+    }
+
+    // Redistributes the dataset by value range with Sample Sort, so that every
+    // process holds one sorted, contiguous range of the sorted dataset, and
+    // shares the splitter table. Datasets flagged as sorted are already
+    // range partitioned.
+    void partitionByRange() {
+        if (!presorted) {
+            sample_sort_buckets(local_dataset, total_elements, rank, num_processes, comm);
+        }
+
+        int local_n = local_dataset.size();
+        int offset = 0;
+        MPI_Exscan(&local_n, &offset, 1, MPI_INT, MPI_SUM, comm);
+        if (rank == 0) {
+            offset = 0;
+        }
+        local_offset = offset;
 
-        int pivot = arr[high];
-        int i = low - 1;
+        int entry[4] = {local_n, local_n ? local_dataset.front() : 0, local_n ? local_dataset.back() : 0, offset};
+        vector<int> table(4 * num_processes);
+        MPI_Allgather(entry, 4, MPI_INT, table.data(), 4, MPI_INT, comm);
 
-        for (int j = low; j < high; j++) {
-            if (arr[j] <= pivot) {
-                i++;
-                swap(arr[i], arr[j]);
+        owner_rank.clear();
+        owner_min.clear();
+        owner_max.clear();
+        owner_offset.clear();
+        for (int r = 0; r < num_processes; r++) {
+            if (table[4 * r] > 0) {
+                owner_rank.push_back(r);
+                owner_min.push_back(table[4 * r + 1]);
+                owner_max.push_back(table[4 * r + 2]);
+                owner_offset.push_back(table[4 * r + 3]);
             }
         }
-        swap(arr[i + 1], arr[high]);
-        return i + 1;
     }
 
-    void quickSort(vector<int>& arr, int low, int high) {
-        if (low < high) {
-            int pivot_index = partition(arr, low, high);
-            quickSort(arr, low, pivot_index - 1);
-            quickSort(arr, pivot_index + 1, high);
+    // Index into the splitter table of the process that holds the first
+    // element not smaller than target, or -1 if no process can hold target.
+    // The processes before it only hold smaller values.
+    int findOwner(int target) {
+        int k = lower_bound(owner_max.begin(), owner_max.end(), target) - owner_max.begin();
+        if (k == (int)owner_max.size() || owner_min[k] > target) {
+            return -1;
         }
+        return k;
     }
 
-    int binarySearch(const vector<int>& arr, int target) {
-        int left = 0, right = arr.size() - 1;
-        while (left <= right) {
-            int mid = left + (right - left) / 2;
-            if (arr[mid] == target) {
-                return mid;
+    // Index of the process whose local lower bound of target, added to its
+    // offset, is the global lower bound (the number of elements smaller than
+    // target). Returns -1 if the table alone answers it; known then holds the
+    // answer.
+    int lowerOwner(int target, int& known) {
+        int k = lower_bound(owner_max.begin(), owner_max.end(), target) - owner_max.begin();
+        if (k == (int)owner_max.size()) {
+            known = total_elements;
+            return -1;
+        }
+        if (owner_min[k] >= target) {
+            known = owner_offset[k];
+            return -1;
+        }
+        return k;
+    }
+
+    // Global position of the first occurrence of target in this process's
+    // range, or -1
+    int searchLocalDataset(int target) {
+        int local_index = index.find(target);
+        if (local_index == -1) {
+            return -1;
+        }
+        return local_offset + local_index;
+    }
+
+    // Answer of this process to a routed query: a position for QUERY_TAG, a
+    // global lower bound for LOWER_TAG
+    int answerQuery(int tag, int target) {
+        if (tag == LOWER_TAG) {
+            return local_offset + index.lowerBound(target);
+        }
+        return searchLocalDataset(target);
+    }
+
+    // Answer of this process to ranges [a, b] given as pairs: for every range
+    // the global lower bound of a, the number of local elements in the range
+    // and the elements themselves
+    void answerLists(const int* pairs, int count, vector<int>& reply) {
+        reply.clear();
+        for (int i = 0; i < count; i++) {
+            int a = pairs[2 * i], b = pairs[2 * i + 1];
+            int first = index.lowerBound(a);
+            int last = b == INT_MAX ? index.size() : index.lowerBound(b + 1);
+            last = max(first, last);
+            reply.push_back(local_offset + first);
+            reply.push_back(last - first);
+            reply.insert(reply.end(), local_dataset.begin() + first, local_dataset.begin() + last);
+        }
+    }
+
+    // Loop of the processes other than 0 during a batch: answer blocks of
+    // queries until process 0 says the batch is done. The tag of a block
+    // says what kind of queries it holds.
+    void serveQueries() {
+        vector<int> queries, answers;
+        while (true) {
+            MPI_Status status;
+            MPI_Probe(0, MPI_ANY_TAG, comm, &status);
+            int count = 0;
+            MPI_Get_count(&status, MPI_INT, &count);
+            queries.resize(max(count, 1));
+            MPI_Recv(queries.data(), count, MPI_INT, 0, status.MPI_TAG, comm, MPI_STATUS_IGNORE);
+            if (status.MPI_TAG == DONE_TAG) {
+                break;
             }
-            else if (arr[mid] < target) {
-                left = mid + 1;
+
+            if (status.MPI_TAG == LIST_TAG) {
+                answerLists(queries.data(), count / 2, answers);
             }
             else {
-                right = mid - 1;
+                answers.resize(count);
+                for (int i = 0; i < count; i++) {
+                    answers[i] = answerQuery(status.MPI_TAG, queries[i]);
+                }
             }
+            MPI_Send(answers.data(), answers.size(), MPI_INT, 0, ANSWER_TAG, comm);
         }
-        return -1;
     }
 
-    void partitionDataAcrossProcesses() {
-        int total_elements = global_dataset.size();
-        int base_partition_size = total_elements / num_processes;
-        int remainder = total_elements % num_processes;
-        vector<int> send_counts(num_processes);
-        vector<int> displacements(num_processes);
-        int start_index = 0;
+    // Ends the serveQueries loop of the other processes
+    void finishBatch() {
+        for (int r = 1; r < num_processes; r++) {
+            MPI_Send(nullptr, 0, MPI_INT, r, DONE_TAG, comm);
+        }
+    }
 
-        for (int p = 0; p < num_processes; ++p) {
-            send_counts[p] = (p < remainder) ? (base_partition_size + 1) : base_partition_size;
-            displacements[p] = start_index;
-            start_index += send_counts[p];
+    // Answers targets held by process 0 with one result each (see findBatch
+    // and lowerBatch). Process 0 looks up the owner of every query in the
+    // splitter table and sends each owner only its own queries, so a query
+    // involves one process and no collective.
+    void routeBatch(const vector<int>& targets, int tag, vector<int>& results) {
+        if (rank != 0) {
+            serveQueries();
+            return;
         }
 
-        local_dataset.resize(send_counts[rank]);
-        MPI_Scatterv(global_dataset.data(), send_counts.data(), displacements.data(), MPI_INT,
-            local_dataset.data(), send_counts[rank], MPI_INT, 0, comm);
+        results.assign(targets.size(), -1);
+        int owners = owner_rank.size();
+        vector<vector<int>> routed(owners), routed_index(owners), answers(owners);
+        vector<MPI_Request> requests;
+        for (size_t first = 0; first < targets.size(); first += QUERY_BLOCK) {
+            size_t last = min(targets.size(), first + QUERY_BLOCK);
+            for (int k = 0; k < owners; k++) {
+                routed[k].clear();
+                routed_index[k].clear();
+            }
+            for (size_t i = first; i < last; i++) {
+                int known = -1;
+                int k = tag == LOWER_TAG ? lowerOwner(targets[i], known) : findOwner(targets[i]);
+                if (k >= 0) {
+                    routed[k].push_back(targets[i]);
+                    routed_index[k].push_back(i);
+                }
+                else {
+                    results[i] = known;
+                }
+            }
 
-        if (!local_dataset.empty()) {
-            quickSort(local_dataset, 0, local_dataset.size() - 1);
+            // Send the queries away first, then answer the local ones
+            requests.clear();
+            for (int k = 0; k < owners; k++) {
+                if (owner_rank[k] != 0 && !routed[k].empty()) {
+                    requests.emplace_back();
+                    MPI_Isend(routed[k].data(), routed[k].size(), MPI_INT, owner_rank[k], tag, comm, &requests.back());
+                }
+            }
+            for (int k = 0; k < owners; k++) {
+                if (routed[k].empty()) {
+                    continue;
+                }
+                answers[k].resize(routed[k].size());
+                if (owner_rank[k] == 0) {
+                    for (size_t i = 0; i < routed[k].size(); i++) {
+                        answers[k][i] = answerQuery(tag, routed[k][i]);
+                    }
+                }
+                else {
+                    MPI_Recv(answers[k].data(), answers[k].size(), MPI_INT, owner_rank[k], ANSWER_TAG, comm, MPI_STATUS_IGNORE);
+                }
+                for (size_t i = 0; i < routed[k].size(); i++) {
+                    results[routed_index[k][i]] = answers[k][i];
+                }
+            }
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
         }
+        finishBatch();
     }
 
+    // Answers range queries [a, b] held by process 0 without an index: every
+    // process counts the elements of its partition below a and above b, and
+    // the counts are summed on process 0 (below[i] and above[i]). The ranges
+    // are broadcast in blocks of SCAN_BLOCK; the MPI_Ireduce of a block runs
+    // while the next block is scanned.
+    void scanBatch(const vector<pair<int, int>>& ranges, vector<int>& below, vector<int>& above) {
+        long long count = ranges.size();
+        MPI_Bcast(&count, 1, MPI_LONG_LONG, 0, comm);
+        below.assign(rank == 0 ? count : 0, 0);
+        above.assign(rank == 0 ? count : 0, 0);
 
-    bool readDatasetFromFile(const string& filename) {
-        if (rank != 0) return true;
-
-        ifstream file(filename);
-        if (!file.is_open()) {
-            return false;
+        vector<int> block(2 * SCAN_BLOCK), local[2], global[2];
+        for (int i = 0; i < 2; i++) {
+            local[i].resize(2 * SCAN_BLOCK);
+            global[i].resize(2 * SCAN_BLOCK);
         }
+        MPI_Request pending = MPI_REQUEST_NULL;
+        long long pending_first = 0;
+        int pending_n = 0, cur = 0;
+        int n = local_dataset.size();
+
+        // Copies the summed counts of the block in flight to the results
+        auto collect = [&]() {
+            MPI_Wait(&pending, MPI_STATUS_IGNORE);
+            if (rank == 0) {
+                const vector<int>& sums = global[cur ^ 1];
+                for (int j = 0; j < pending_n; j++) {
+                    below[pending_first + j] = sums[2 * j];
+                    above[pending_first + j] = sums[2 * j + 1];
+                }
+            }
+        };
+
+        for (long long first = 0; first < count; first += SCAN_BLOCK) {
+            int block_n = (int)min<long long>(SCAN_BLOCK, count - first);
+            if (rank == 0) {
+                for (int j = 0; j < block_n; j++) {
+                    block[2 * j] = ranges[first + j].first;
+                    block[2 * j + 1] = ranges[first + j].second;
+                }
+            }
+            MPI_Bcast(block.data(), 2 * block_n, MPI_INT, 0, comm);
 
-        global_dataset.clear();
-        string line;
-        while (getline(file, line)) {
-            istringstream iss(line);
-            int num;
-            while (iss >> num) {
-                global_dataset.push_back(num);
+            vector<int>& counts = local[cur];
+            fill(counts.begin(), counts.begin() + 2 * block_n, 0);
+            for (int c = 0; c < n; c += SCAN_CHUNK) {
+                int chunk = min(SCAN_CHUNK, n - c);
+                for (int j = 0; j < block_n; j++) {
+                    scanChunk(local_dataset.data() + c, chunk, block[2 * j], block[2 * j + 1], counts[2 * j], counts[2 * j + 1]);
+                }
             }
+
+            collect();
+            MPI_Ireduce(counts.data(), global[cur].data(), 2 * block_n, MPI_INT, MPI_SUM, 0, comm, &pending);
+            pending_first = first;
+            pending_n = block_n;
+            cur ^= 1;
         }
+        collect();
+    }
 
-        file.close();
-        return !global_dataset.empty();
+public:
+    ParallelQuickSearch(MPI_Comm comm_world, int world_rank, int world_size) :
+        total_elements(0), presorted(false), rank(world_rank), num_processes(world_size), comm(comm_world), local_offset(0), indexed(false) {
     }
 
-    int searchLocalDataset(int target) {
-        if (local_dataset.empty()) return -1;
+    // Reads the dataset. If expected_queries lookups are cheaper by scanning
+    // (scanIsCheaper), the partitions stay as they are; otherwise they are
+    // partitioned by value range and the local index is built in the given
+    // layout. expected_queries < 0 always builds the index. Afterwards any
+    // number of queries can be answered without touching the file again.
+    bool loadDataset(const string& filename, int layout, long long expected_queries) {
+        if (!readDatasetFromFile(filename)) {
+            return false;
+        }
+        indexed = expected_queries < 0 || !scanIsCheaper(total_elements, num_processes, expected_queries, presorted);
+        if (indexed) {
+            partitionByRange();
+            index.build(local_dataset, layout);
+        }
+        return true;
+    }
 
-        int local_index = binarySearch(local_dataset, target);
-        if (local_index == -1) return -1;
+    bool usesIndex() const {
+        return indexed;
+    }
 
-        int base_index = 0;
-        for (int p = 0; p < rank; ++p) {
-            base_index += (p < (global_dataset.size() % num_processes)) ?
-                (global_dataset.size() / num_processes + 1) :
-                (global_dataset.size() / num_processes);
+    // Answers a batch of targets held by process 0; positions are the global
+    // positions of the first occurrence in the sorted dataset (-1 = not
+    // found). The other processes serve queries until the batch is done.
+    void findBatch(const vector<int>& targets, vector<int>& positions) {
+        if (indexed) {
+            routeBatch(targets, QUERY_TAG, positions);
+            return;
+        }
+
+        // Without an index the first occurrence of x sits after the elements
+        // below x, provided that x occurs at all
+        vector<pair<int, int>> ranges;
+        for (int target : targets) {
+            ranges.emplace_back(target, target);
+        }
+        vector<int> below, above;
+        scanBatch(ranges, below, above);
+        positions.assign(below.size(), -1);
+        for (size_t i = 0; i < below.size(); i++) {
+            if (total_elements - below[i] - above[i] > 0) {
+                positions[i] = below[i];
+            }
         }
-        return base_index + local_index;
     }
 
-public:
-    ParallelQuickSearch(MPI_Comm comm_world) :
-        rank(0), num_processes(1), comm(comm_world) {
-        MPI_Comm_rank(comm_world, &rank);
-        MPI_Comm_size(comm_world, &num_processes);
+    // Global lower bound of every value: the number of elements of the whole
+    // dataset that are smaller than it
+    void lowerBatch(const vector<int>& values, vector<int>& bounds) {
+        if (indexed) {
+            routeBatch(values, LOWER_TAG, bounds);
+            return;
+        }
+        vector<pair<int, int>> ranges;
+        for (int value : values) {
+            ranges.emplace_back(value, value);
+        }
+        vector<int> above;
+        scanBatch(ranges, bounds, above);
     }
 
-    int findElement(const string& filename, int target) {
+    // Number of elements in each range [a, b], as the difference of the
+    // global lower bounds of a and b + 1 (the upper bound of b)
+    void countBatch(const vector<pair<int, int>>& ranges, vector<int>& counts) {
+        if (!indexed) {
+            vector<int> below, above;
+            scanBatch(ranges, below, above);
+            counts.assign(below.size(), 0);
+            for (size_t i = 0; i < below.size(); i++) {
+                counts[i] = max(0, total_elements - below[i] - above[i]);
+            }
+            return;
+        }
 
-        if (rank == 0) {
-            if (!readDatasetFromFile(filename)) {
-                return -2;  // read error
+        vector<int> values, bounds;
+        for (const auto& range : ranges) {
+            values.push_back(range.first);
+            if (range.second < INT_MAX) {
+                values.push_back(range.second + 1);
             }
         }
+        lowerBatch(values, bounds);
+        if (rank != 0) {
+            return;
+        }
 
-        int total_size = global_dataset.size();
-        MPI_Bcast(&total_size, 1, MPI_INT, 0, comm);
+        counts.assign(ranges.size(), 0);
+        size_t v = 0;
+        for (size_t i = 0; i < ranges.size(); i++) {
+            int lower = bounds[v++];
+            int upper = ranges[i].second < INT_MAX ? bounds[v++] : total_elements;
+            counts[i] = max(0, upper - lower);
+        }
+    }
+
+    // Every element of each range [a, b], in sorted order, with the global
+    // position of the first one: the elements of range i sit at positions
+    // firsts[i] .. firsts[i] + values[i].size() - 1 of the sorted dataset.
+    // Process 0 asks every process whose value range overlaps [a, b]. Needs
+    // the index.
+    void listBatch(const vector<pair<int, int>>& ranges, vector<int>& firsts, vector<vector<int>>& values) {
         if (rank != 0) {
-            global_dataset.resize(total_size);
+            serveQueries();
+            return;
+        }
+
+        firsts.assign(ranges.size(), 0);
+        values.assign(ranges.size(), vector<int>());
+        vector<bool> seen(ranges.size(), false);
+        int owners = owner_rank.size();
+        vector<vector<int>> routed(owners), routed_index(owners);
+        vector<int> reply;
+        vector<MPI_Request> requests;
+        for (size_t first = 0; first < ranges.size(); first += QUERY_BLOCK) {
+            size_t last = min(ranges.size(), first + QUERY_BLOCK);
+            for (int k = 0; k < owners; k++) {
+                routed[k].clear();
+                routed_index[k].clear();
+            }
+            for (size_t i = first; i < last; i++) {
+                int a = ranges[i].first, b = ranges[i].second;
+                // Without an overlapping process the table gives the position
+                int known = 0;
+                if (lowerOwner(a, known) < 0) {
+                    firsts[i] = known;
+                }
+                int k = lower_bound(owner_max.begin(), owner_max.end(), a) - owner_max.begin();
+                for (; k < owners && owner_min[k] <= b && a <= b; k++) {
+                    routed[k].push_back(a);
+                    routed[k].push_back(b);
+                    routed_index[k].push_back(i);
+                }
+            }
+
+            requests.clear();
+            for (int k = 0; k < owners; k++) {
+                if (owner_rank[k] != 0 && !routed[k].empty()) {
+                    requests.emplace_back();
+                    MPI_Isend(routed[k].data(), routed[k].size(), MPI_INT, owner_rank[k], LIST_TAG, comm, &requests.back());
+                }
+            }
+
+            // The owners are in value order, so appending their elements in
+            // owner order keeps every range sorted
+            for (int k = 0; k < owners; k++) {
+                if (routed[k].empty()) {
+                    continue;
+                }
+                if (owner_rank[k] == 0) {
+                    answerLists(routed[k].data(), routed_index[k].size(), reply);
+                }
+                else {
+                    MPI_Status status;
+                    MPI_Probe(owner_rank[k], ANSWER_TAG, comm, &status);
+                    int count = 0;
+                    MPI_Get_count(&status, MPI_INT, &count);
+                    reply.resize(max(count, 1));
+                    MPI_Recv(reply.data(), count, MPI_INT, owner_rank[k], ANSWER_TAG, comm, MPI_STATUS_IGNORE);
+                }
+
+                // The first process asked about a range holds its lower bound
+                size_t pos = 0;
+                for (int i : routed_index[k]) {
+                    int lower = reply[pos], count = reply[pos + 1];
+                    pos += 2;
+                    if (!seen[i]) {
+                        firsts[i] = lower;
+                        seen[i] = true;
+                    }
+                    values[i].insert(values[i].end(), reply.begin() + pos, reply.begin() + pos + count);
+                    pos += count;
+                }
+            }
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
         }
+        finishBatch();
+    }
+
+    // A single search: for one query a scan of the unsorted partitions is
+    // cheaper than sorting them, so no index is built
+    int findElement(const string& filename, int target) {
 
+        if (!loadDataset(filename, LAYOUT_SORTED, 1)) {
+            return -2;  // read error
+        }
 
-        partitionDataAcrossProcesses();
-        int local_result = searchLocalDataset(target);
-        int global_result = -1;
-        MPI_Reduce(&local_result, &global_result, 1, MPI_INT, MPI_MAX, 0, comm);
+        vector<int> positions;
+        findBatch(vector<int>(1, target), positions);
 
-        return (rank == 0) ? global_result : -1;
+        return (rank == 0) ? positions[0] : -1;
     }
 };
 
@@ -154,7 +813,7 @@ bool runQuickSearch(const char* inputFile, const char* outputFile, int target, i
     double start_time = MPI_Wtime();
 
 
-    ParallelQuickSearch pqs(comm);
+    ParallelQuickSearch pqs(comm, rank, size);
 
 
     int result = pqs.findElement(inputFile, target);
@@ -190,4 +849,232 @@ bool runQuickSearch(const char* inputFile, const char* outputFile, int target, i
     }
 
     return (result >= -1);
-}
\ No newline at end of file
+}
+
+// Kinds of queries in a session's query file
+const int FIND_QUERY = 0;  // "x": position of the first occurrence of x
+const int COUNT_QUERY = 1; // "count x": number of occurrences of x
+const int RANGE_QUERY = 2; // "range a b": number of elements in [a, b]
+const int LIST_QUERY = 3;  // "list a b": every element in [a, b] with its position
+
+struct SessionQuery {
+    int type;
+    int a, b;
+};
+
+// Reads queries until the end of the file or the first malformed query
+void readSessionQueries(istream& in, vector<SessionQuery>& queries) {
+    string word;
+    while (in >> word) {
+        SessionQuery query = {FIND_QUERY, 0, 0};
+        if (word == "count") {
+            query.type = COUNT_QUERY;
+            if (!(in >> query.a)) {
+                break;
+            }
+            query.b = query.a;
+        }
+        else if (word == "range" || word == "list") {
+            query.type = word == "range" ? RANGE_QUERY : LIST_QUERY;
+            if (!(in >> query.a >> query.b)) {
+                break;
+            }
+        }
+        else {
+            istringstream number(word);
+            if (!(number >> query.a) || !number.eof()) {
+                break;
+            }
+        }
+        queries.push_back(query);
+    }
+}
+
+// Session mode: the dataset is read and indexed once in the given layout,
+// then every query of queryFile is answered against it. Queries of the same
+// kind are answered together in one batch. For a few queries the index does
+// not pay off and they are answered by scanning instead.
+bool runQuickSearchSession(const char* inputFile, const char* queryFile, const char* outputFile,
+                           int layout, int rank, int size, MPI_Comm comm) {
+    // Process 0 reads the queries; they are small compared to the dataset
+    vector<SessionQuery> queries;
+    int readable = 1;
+    if (rank == 0) {
+        ifstream in(queryFile);
+        readable = in.is_open();
+        readSessionQueries(in, queries);
+    }
+    MPI_Bcast(&readable, 1, MPI_INT, 0, comm);
+    if (!readable) {
+        if (rank == 0) {
+            cout << "Error: Could not open query file " << queryFile << "\n";
+        }
+        return false;
+    }
+
+    // The number of queries decides between scanning and indexing; list
+    // queries need the index
+    long long expected_queries = queries.size();
+    for (const auto& query : queries) {
+        if (query.type == LIST_QUERY) {
+            expected_queries = -1;
+        }
+    }
+    MPI_Bcast(&expected_queries, 1, MPI_LONG_LONG, 0, comm);
+
+    MPI_Barrier(comm);
+    double start_time = MPI_Wtime();
+
+    ParallelQuickSearch pqs(comm, rank, size);
+    if (!pqs.loadDataset(inputFile, layout, expected_queries)) {
+        if (rank == 0) {
+            cout << "Error: Could not open input file\n";
+        }
+        return false;
+    }
+
+    MPI_Barrier(comm);
+    double build_time = MPI_Wtime();
+
+    vector<int> targets;
+    vector<pair<int, int>> counted, listed;
+    for (const auto& query : queries) {
+        if (query.type == FIND_QUERY) {
+            targets.push_back(query.a);
+        }
+        else if (query.type == LIST_QUERY) {
+            listed.emplace_back(query.a, query.b);
+        }
+        else {
+            counted.emplace_back(query.a, query.b);
+        }
+    }
+
+    vector<int> positions, counts, firsts;
+    vector<vector<int>> values;
+    pqs.findBatch(targets, positions);
+    pqs.countBatch(counted, counts);
+    pqs.listBatch(listed, firsts, values);
+
+    double end_time = MPI_Wtime();
+    MPI_Barrier(comm);
+
+    if (rank == 0) {
+        double build_ms = (build_time - start_time) * 1000;
+        double query_ms = (end_time - build_time) * 1000;
+        double rate = query_ms > 0 ? queries.size() / (query_ms / 1000) : 0;
+
+        ofstream outFile(outputFile);
+        outFile << "Quick Search Session Results:\n";
+        if (pqs.usesIndex()) {
+            outFile << "Index (" << layoutName(layout) << " layout) built in " << build_ms << " ms\n";
+        }
+        else {
+            outFile << "Dataset loaded in " << build_ms << " ms; queries answered by scanning\n";
+        }
+        outFile << "Answered " << queries.size() << " queries in " << query_ms << " ms (" << rate << " queries/s)\n";
+        size_t next_find = 0, next_count = 0, next_list = 0;
+        for (const auto& query : queries) {
+            if (query.type == FIND_QUERY) {
+                int position = positions[next_find++];
+                if (position == -1) {
+                    outFile << "Target " << query.a << " not found in dataset\n";
+                }
+                else {
+                    outFile << "Target " << query.a << " found at position " << position << "\n";
+                }
+            }
+            else if (query.type == COUNT_QUERY) {
+                outFile << "Target " << query.a << " occurs " << counts[next_count++] << " times\n";
+            }
+            else if (query.type == RANGE_QUERY) {
+                outFile << "Range [" << query.a << ", " << query.b << "] holds " << counts[next_count++] << " elements\n";
+            }
+            else {
+                const vector<int>& found = values[next_list];
+                int first = firsts[next_list++];
+                outFile << "Range [" << query.a << ", " << query.b << "] holds " << found.size() << " elements";
+                if (!found.empty()) {
+                    outFile << " at positions " << first << " to " << first + found.size() - 1 << ":";
+                    for (int value : found) {
+                        outFile << " " << value;
+                    }
+                }
+                outFile << "\n";
+            }
+        }
+        outFile.close();
+
+        if (pqs.usesIndex()) {
+            cout << "Quick Search index build time (" << layoutName(layout) << " layout): " << build_ms << " ms\n";
+        }
+        else {
+            cout << "Quick Search load time: " << build_ms << " ms (few queries, answered by scanning)\n";
+        }
+        cout << "Quick Search answered " << queries.size() << " queries in " << query_ms << " ms ("
+             << rate << " queries/s)\n";
+    }
+
+    return true;
+}
+
+// Benchmark of the local index layouts on one process, without communication:
+//   mpic++ -O2 -DQUICK_SEARCH_BENCH -o qs_bench Quick_Search.cpp Sample_Sort.cpp Local_Sort.cpp Parallel_IO.cpp
+//   ./qs_bench [max_n]
+#ifdef QUICK_SEARCH_BENCH
+#include <chrono>
+#include <random>
+
+int main(int argc, char* argv[]) {
+    int max_n = argc > 1 ? atoi(argv[1]) : 1 << 24;
+    const int queries = 1 << 22;
+    const int repeats = 3;
+    const int layouts[3] = {LAYOUT_SORTED, LAYOUT_EYTZINGER, LAYOUT_STREE};
+
+    mt19937 gen(42);
+    cout << "Lookups per second\nkeys\tsorted\teytzinger\tstree\n";
+    for (int n = 1 << 10; n <= max_n; n *= 4) {
+        // Keys drawn from a range of 2n values, so about half of the queries hit
+        vector<int> keys(n);
+        for (auto& key : keys) {
+            key = (int)(gen() % (2u * n));
+        }
+        sort(keys.begin(), keys.end());
+        vector<int> targets(queries);
+        for (auto& target : targets) {
+            target = (int)(gen() % (2u * n + 1));
+        }
+
+        cout << n;
+        for (int layout : layouts) {
+            LocalIndex index;
+            index.build(keys, layout);
+
+            // Best of several runs; the checksum keeps the lookups alive
+            double best = 1e30;
+            long long checksum = 0;
+            for (int r = 0; r < repeats; r++) {
+                checksum = 0;
+                auto start = chrono::steady_clock::now();
+                for (int target : targets) {
+                    checksum += index.lowerBound(target);
+                }
+                auto end = chrono::steady_clock::now();
+                best = min(best, chrono::duration<double>(end - start).count());
+            }
+
+            long long expected = 0;
+            for (int target : targets) {
+                expected += lower_bound(keys.begin(), keys.end(), target) - keys.begin();
+            }
+            if (checksum != expected) {
+                cout << "\nError: " << layoutName(layout) << " layout disagrees with lower_bound\n";
+                return 1;
+            }
+            cout << "\t" << queries / best;
+        }
+        cout << "\n";
+    }
+    return 0;
+}
+#endif
@@ -6,87 +6,139 @@
 #include <climits>
 #include <fstream>
 #include <cmath> 
+#include <algorithm>
+#include <thread>
 
 using namespace std;
 
-int choose_pivot(int *arr, int low, int high)
+extern bool readLocalPartition(const char *inputFile, vector<int> &local_data, int &total_n, int rank, int size, MPI_Comm comm);
+extern bool writeDistributedArray(const char *outputFile, const int *data, int local_n, const char *label, bool append, int rank, int size, MPI_Comm comm);
+extern bool isBinaryOutput(const char *outputFile);
+extern void rebalancePartition(vector<int> &local_data, int total_n, int rank, int size, MPI_Comm comm);
+extern long long blockOffset(int total, int size, int r);
+extern void localSort(int *data, int n);
+
+// Samples per process are SAMPLE_SORT_OVERSAMPLING * (p - 1). With s regular
+// samples per process no bucket exceeds (n/p) * (1 + (p - 1) / (s + 1)), so
+// an oversampling factor a bounds every bucket by (1 + 1/a) * n/p.
+#ifndef SAMPLE_SORT_OVERSAMPLING
+#define SAMPLE_SORT_OVERSAMPLING 8
+#endif
+
+// A key made unique by where it comes from: equal values are ordered by the
+// rank that holds them and their position in its sorted block, so splitters
+// can fall between copies of the same value
+struct SampleKey
 {
-    int mid = low + (high - low) / 2;
+    int value, rank, index;
+};
 
-    if (arr[low] > arr[mid])
-        swap(arr[low], arr[mid]);
-    if (arr[mid] > arr[high])
-        swap(arr[mid], arr[high]);
-    if (arr[low] > arr[mid])
-        swap(arr[low], arr[mid]);
+// Larger than the key of any element
+const SampleKey MAX_KEY = {INT_MAX, INT_MAX, INT_MAX};
 
-    swap(arr[mid], arr[high]);
-
-    return arr[high];
+bool key_less(const SampleKey &a, const SampleKey &b)
+{
+    if (a.value != b.value)
+        return a.value < b.value;
+    if (a.rank != b.rank)
+        return a.rank < b.rank;
+    return a.index < b.index;
 }
 
-void quicksort(int *arr, int low, int high)
+void select_local_samples(int *local_array, int local_size, int rank, SampleKey *local_samples, int sample_size)
 {
-    if (low < high)
+    for (int i = 0; i < sample_size; i++)
     {
-        int pivot = choose_pivot(arr, low, high);
-        int i = low - 1;
-
-        for (int j = low; j < high; j++)
-        {
-            if (arr[j] <= pivot)
-            {
-                i++;
-                swap(arr[i], arr[j]);
-            }
-        }
-        swap(arr[i + 1], arr[high]);
-
-        int pivot_pos = i + 1;
-        quicksort(arr, low, pivot_pos - 1);
-        quicksort(arr, pivot_pos + 1, high);
+        int index = (int)((long long)(i + 1) * local_size / (sample_size + 1));
+        local_samples[i] = (local_size > 0) ? SampleKey{local_array[index], rank, index} : MAX_KEY;
     }
 }
 
-void calculate_counts_and_displs(int *send_counts, int *send_displs, int size, int total_size)
+void select_splitters(SampleKey *samples, int total_samples, SampleKey *splitters, int size)
 {
-    int base = total_size / size, rem = total_size % size;
-    for (int i = 0; i < size; i++)
+    sort(samples, samples + total_samples, key_less);
+    for (int i = 0; i < size - 1; i++)
     {
-        send_counts[i] = base + (i < rem ? 1 : 0);
-        send_displs[i] = (i == 0) ? 0 : send_displs[i - 1] + send_counts[i - 1];
+        splitters[i] = samples[(i + 1) * (total_samples / size)];
     }
+    splitters[size - 1] = MAX_KEY;
 }
 
-void select_local_samples(int *local_array, int local_size, int *local_samples, int sample_size)
+// Number of elements walked down the splitter tree together, so that their
+// independent loads and compares overlap instead of waiting on each other
+const int CLASSIFY_UNROLL = 8;
+
+// Lay the size - 1 splitters out as an implicit binary search tree in
+// Eytzinger order: the root is node 1 and the children of node i are 2i and
+// 2i + 1. Missing splitters are MAX_KEY, so the tree is always complete.
+// Returns the number of levels; tree needs 2^levels entries (tree[0] is unused).
+int build_splitter_tree(const SampleKey *splitters, int size, SampleKey *tree)
 {
-    for (int i = 0; i < sample_size; i++)
+    int levels = 0;
+    while ((1 << levels) < size)
+        levels++;
+
+    for (int node = 1; node < (1 << levels); node++)
     {
-        local_samples[i] = local_array[(i + 1) * local_size / (sample_size + 1)];
+        // In-order position of the node in a complete tree of this height
+        int depth = 31 - __builtin_clz(node);
+        int pos = ((2 * (node - (1 << depth)) + 1) << (levels - 1 - depth)) - 1;
+        tree[node] = (pos < size - 1) ? splitters[pos] : MAX_KEY;
     }
+    return levels;
 }
 
-void select_splitters(int *samples, int total_samples, int *splitters, int size)
+// Is the element (value, rank, index) larger than key? Written with
+// non-short-circuit operators so that it compiles to flag arithmetic
+inline int key_greater(int value, int rank, int index, const SampleKey &key)
 {
-    quicksort(samples, 0, total_samples - 1);
-    for (int i = 0; i < size - 1; i++)
+    return (value > key.value) |
+           ((value == key.value) & ((rank > key.rank) | ((rank == key.rank) & (index > key.index))));
+}
+
+// Bucket of every element: the number of splitters smaller than it. Each
+// level is one compare whose result is added to the node index, so the walk
+// has no data-dependent branches.
+void classify_elements(const int *local_array, int local_size, int rank, const SampleKey *tree, int levels,
+                       int *buckets, int *partition_counts)
+{
+    int num_leaves = 1 << levels;
+    int i = 0;
+    for (; i + CLASSIFY_UNROLL <= local_size; i += CLASSIFY_UNROLL)
     {
-        splitters[i] = samples[(i + 1) * (total_samples / size)];
+        int node[CLASSIFY_UNROLL];
+        for (int u = 0; u < CLASSIFY_UNROLL; u++)
+            node[u] = 1;
+        for (int l = 0; l < levels; l++)
+            for (int u = 0; u < CLASSIFY_UNROLL; u++)
+                node[u] = 2 * node[u] + key_greater(local_array[i + u], rank, i + u, tree[node[u]]);
+        for (int u = 0; u < CLASSIFY_UNROLL; u++)
+        {
+            buckets[i + u] = node[u] - num_leaves;
+            partition_counts[node[u] - num_leaves]++;
+        }
+    }
+    for (; i < local_size; i++)
+    {
+        int node = 1;
+        for (int l = 0; l < levels; l++)
+            node = 2 * node + key_greater(local_array[i], rank, i, tree[node]);
+        buckets[i] = node - num_leaves;
+        partition_counts[node - num_leaves]++;
     }
-    splitters[size - 1] = INT_MAX;
 }
 
-void partition_data(int *local_array, int local_size, int *splitters, int size,
+// local_array must be sorted: the position of an element is part of its key
+void partition_data(int *local_array, int local_size, SampleKey *splitters, int rank, int size,
                     int *partition_counts, int *send_buf, int *send_displs)
 {
     int *temp_displs = (int *)calloc(size, sizeof(int));
-    for (int i = 0; i < local_size; i++)
-    {
-        int j = 0;
-        while (j < size - 1 && local_array[i] > splitters[j])
-            j++;
-        partition_counts[j]++;
-    }
+    SampleKey *tree = (SampleKey *)malloc(2 * size * sizeof(SampleKey));
+    int *buckets = (int *)malloc(max(local_size, 1) * sizeof(int));
+
+    // First pass: classify every element once and remember its bucket
+    int levels = build_splitter_tree(splitters, size, tree);
+    classify_elements(local_array, local_size, rank, tree, levels, buckets, partition_counts);
 
     send_displs[0] = 0;
     for (int i = 1; i < size; i++)
@@ -95,133 +147,180 @@ void partition_data(int *local_array, int local_size, int *splitters, int size,
     for (int i = 0; i < size; i++)
         temp_displs[i] = send_displs[i];
 
+    // Second pass: scatter with the cached buckets
     for (int i = 0; i < local_size; i++)
-    {
-        int j = 0;
-        while (j < size - 1 && local_array[i] > splitters[j])
-            j++;
-        send_buf[temp_displs[j]++] = local_array[i];
-    }
+        send_buf[temp_displs[buckets[i]]++] = local_array[i];
+
+    free(buckets);
+    free(tree);
     free(temp_displs);
 }
 
-void gather_sorted_data(int *recv_buf, int recv_size, int rank, int size,
-                        int *final_array, int *all_sizes, int *displs)
-{
-    MPI_Gather(&recv_size, 1, MPI_INT, all_sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    if (rank == 0)
-    {
-        displs[0] = 0;
-        for (int i = 1; i < size; i++)
-            displs[i] = displs[i - 1] + all_sizes[i - 1];
-    }
+// Threads used for the final merge of the received runs; with more than one,
+// the output is cut into equal parts that are merged independently
+#ifndef SAMPLE_SORT_MERGE_THREADS
+#define SAMPLE_SORT_MERGE_THREADS 1
+#endif
 
-    MPI_Gatherv(recv_buf, recv_size, MPI_INT,
-                final_array, all_sizes, displs, MPI_INT,
-                0, MPI_COMM_WORLD);
-}
+// Below this many elements per thread the merge is not split
+const int MIN_MERGE_PER_THREAD = 1 << 16;
 
-bool runSampleSort(const char *inputFile, const char *outputFile, int rank, int size, MPI_Comm comm)
+// Merges the sorted runs [first[r], last[r]) into out with a loser tree: the
+// inner nodes keep the loser of each match and only the path of the run that
+// just produced an element is replayed, so every element costs log2(runs)
+// comparisons. Exhausted runs lose every match.
+void loser_tree_merge(const int *const *first, const int *const *last, int runs, int *out)
 {
-    int *array = NULL;
-    int array_size = 0;
-    bool is_error = false;
+    vector<const int *> head(first, first + runs);
+    int k = 1;
+    while (k < runs)
+        k *= 2;
 
-    if (rank == 0)
+    // Does run a win against run b? Ties go to the lower run
+    auto beats = [&](int a, int b)
     {
-        ifstream file(inputFile);
-        vector<int> data;
-        int el;
-        while (file >> el)
-        {
-            data.push_back(el);
-        }
-        file.close();
-
-        array_size = data.size();
+        if (a >= runs || head[a] == last[a])
+            return false;
+        if (b >= runs || head[b] == last[b])
+            return true;
+        return *head[a] < *head[b] || (*head[a] == *head[b] && a < b);
+    };
+
+    // Play the initial tournament bottom-up
+    vector<int> tree(k), winners(2 * k);
+    for (int r = 0; r < k; r++)
+        winners[k + r] = r;
+    for (int node = k - 1; node >= 1; node--)
+    {
+        int a = winners[2 * node], b = winners[2 * node + 1];
+        winners[node] = beats(a, b) ? a : b;
+        tree[node] = beats(a, b) ? b : a;
+    }
+    int winner = winners[1];
 
-        if (array_size <= 0)
-        {
-            cout << "Error: Invalid input array size\n";
-            is_error = true;
-        }
+    long long total = 0;
+    for (int r = 0; r < runs; r++)
+        total += last[r] - first[r];
 
-        if (!is_error)
+    for (long long i = 0; i < total; i++)
+    {
+        out[i] = *head[winner]++;
+        for (int node = (winner + k) / 2; node >= 1; node /= 2)
         {
-            array = (int *)malloc(array_size * sizeof(int));
-            if (!array)
-            {
-                cout << "Error: Memory allocation failed\n";
-                is_error = true;
-            }
-            else
-            {
-                for (int i = 0; i < array_size; i++)
-                {
-                    array[i] = data[i];
-                }
-
-                ofstream outFile(outputFile);
-                outFile << "Unsorted array: ";
-                for (int i = 0; i < array_size; i++)
-                {
-                    outFile << array[i] << " ";
-                }
-                outFile << endl;
-                outFile.close();
-            }
+            if (beats(tree[node], winner))
+                swap(tree[node], winner);
         }
     }
+}
 
-    MPI_Bcast(&is_error, 1, MPI_C_BOOL, 0, comm);
-
-    if (is_error)
+// Positions split[r] in every run such that the elements before them are the
+// rank smallest of all runs (multiway merge-path split). A binary search over
+// the values finds the smallest v with more than rank elements <= v; the
+// elements equal to v are then taken in run order.
+void split_runs(const int *const *first, const int *const *last, int runs, long long rank,
+                const int **split)
+{
+    long long lo = INT_MIN, hi = INT_MAX;
+    while (lo < hi)
     {
-        return false;
+        long long mid = lo + (hi - lo) / 2;
+        long long count = 0;
+        for (int r = 0; r < runs; r++)
+            count += upper_bound(first[r], last[r], (int)mid) - first[r];
+        if (count > rank)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    MPI_Bcast(&array_size, 1, MPI_INT, 0, comm);
+    long long remaining = rank;
+    for (int r = 0; r < runs; r++)
+    {
+        split[r] = lower_bound(first[r], last[r], (int)lo);
+        remaining -= split[r] - first[r];
+    }
+    for (int r = 0; r < runs && remaining > 0; r++)
+    {
+        long long equal = upper_bound(split[r], last[r], (int)lo) - split[r];
+        long long take = min(equal, remaining);
+        split[r] += take;
+        remaining -= take;
+    }
+}
 
-    MPI_Barrier(comm);
-    double start_time = MPI_Wtime();
+// Merges the runs of recv_buf described by recv_counts / recv_displs into out
+void merge_received_runs(const int *recv_buf, const int *recv_counts, const int *recv_displs,
+                         int size, int recv_size, int *out)
+{
+    int threads = max(1, min(SAMPLE_SORT_MERGE_THREADS, recv_size / MIN_MERGE_PER_THREAD));
 
-    int *send_counts = (int *)malloc(size * sizeof(int));
-    int *send_displs = (int *)malloc(size * sizeof(int));
-    calculate_counts_and_displs(send_counts, send_displs, size, array_size);
+    // bounds[t][r]: where part t starts in run r (bounds[threads] are the run ends)
+    vector<vector<const int *>> bounds(threads + 1, vector<const int *>(size));
+    for (int r = 0; r < size; r++)
+    {
+        bounds[0][r] = recv_buf + recv_displs[r];
+        bounds[threads][r] = recv_buf + recv_displs[r] + recv_counts[r];
+    }
+    for (int t = 1; t < threads; t++)
+        split_runs(bounds[0].data(), bounds[threads].data(), size,
+                   (long long)recv_size * t / threads, bounds[t].data());
 
-    int local_size = send_counts[rank];
-    int *local_array = (int *)malloc(local_size * sizeof(int));
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        int *part_out = out + (long long)recv_size * t / threads;
+        auto merge_part = [&bounds, t, size, part_out]()
+        {
+            loser_tree_merge(bounds[t].data(), bounds[t + 1].data(), size, part_out);
+        };
+        if (t == threads - 1)
+            merge_part();
+        else
+            workers.emplace_back(merge_part);
+    }
+    for (thread &worker : workers)
+        worker.join();
+}
 
-    MPI_Scatterv(array, send_counts, send_displs, MPI_INT,
-                 local_array, local_size, MPI_INT, 0, comm);
+// Sorts the distributed array: on return local_data is this process's bucket,
+// sorted, and the buckets of the ranks follow each other in global order
+bool sample_sort_buckets(vector<int> &local_data, int array_size, int rank, int size, MPI_Comm comm)
+{
+    int local_size = local_data.size();
+    int *local_array = local_data.data();
 
-    quicksort(local_array, 0, local_size - 1); 
-    int samples_per_process = std::max(1, (int)log2(size));
-    int sample_size = samples_per_process * size;
-    int *local_samples = (int *)malloc(sample_size * sizeof(int));
-    select_local_samples(local_array, local_size, local_samples, sample_size);
+    localSort(local_array, local_size);
+    // Regular samples, as many as the smallest block can provide
+    int sample_size = std::max(1, std::min(SAMPLE_SORT_OVERSAMPLING * (size - 1), array_size / size));
+    SampleKey *local_samples = (SampleKey *)malloc(sample_size * sizeof(SampleKey));
+    select_local_samples(local_array, local_size, rank, local_samples, sample_size);
 
-    int *samples = NULL;
+    // A SampleKey travels as three ints
+    SampleKey *samples = NULL;
     if (rank == 0)
     {
-        samples = (int *)malloc(sample_size * size * sizeof(int));
+        samples = (SampleKey *)malloc((long long)sample_size * size * sizeof(SampleKey));
     }
-    MPI_Gather(local_samples, sample_size, MPI_INT,
-               samples, sample_size, MPI_INT, 0, comm);
+    MPI_Gather(local_samples, 3 * sample_size, MPI_INT,
+               samples, 3 * sample_size, MPI_INT, 0, comm);
 
-    int *splitters = (int *)malloc(size * sizeof(int));
+    SampleKey *splitters = (SampleKey *)malloc(size * sizeof(SampleKey));
     if (rank == 0)
     {
         select_splitters(samples, sample_size * size, splitters, size);
     }
-    MPI_Bcast(splitters, size, MPI_INT, 0, comm);
+    MPI_Bcast(splitters, 3 * size, MPI_INT, 0, comm);
 
     int *partition_counts = (int *)calloc(size, sizeof(int));
     int *send_buf = (int *)malloc(local_size * sizeof(int));
     int *send_displs_local = (int *)calloc(size, sizeof(int));
-    partition_data(local_array, local_size, splitters, size,
+    partition_data(local_array, local_size, splitters, rank, size,
                    partition_counts, send_buf, send_displs_local); 
+    free(local_samples);
+    if (rank == 0)
+        free(samples);
+    free(splitters);
+
     int *recv_counts = (int *)malloc(size * sizeof(int));
     if (!recv_counts)
     {
@@ -258,59 +357,103 @@ bool runSampleSort(const char *inputFile, const char *outputFile, int rank, int
     MPI_Alltoallv(send_buf, partition_counts, send_displs_local, MPI_INT,
                   recv_buf, recv_counts, recv_displs, MPI_INT, comm);
 
-    quicksort(recv_buf, 0, recv_size - 1);
+    // Every sender's run is already sorted, so merging them is enough; the
+    // input block is no longer needed and receives the bucket
+    local_data.resize(recv_size);
+    merge_received_runs(recv_buf, recv_counts, recv_displs, size, recv_size, local_data.data());
 
-    int *all_sizes = NULL;
-    int *displs = NULL;
-    if (rank == 0)
+    free(partition_counts);
+    free(send_buf);
+    free(send_displs_local);
+    free(recv_counts);
+    free(recv_buf);
+    free(recv_displs);
+    return true;
+}
+
+bool runSampleSort(const char *inputFile, const char *outputFile, int rank, int size, MPI_Comm comm)
+{
+    int array_size = 0;
+
+    vector<int> local_data;
+    if (!readLocalPartition(inputFile, local_data, array_size, rank, size, comm))
     {
-        all_sizes = (int *)malloc(size * sizeof(int));
-        displs = (int *)malloc(size * sizeof(int));
+        if (rank == 0)
+        {
+            cout << "Error: Unable to read " << inputFile << "\n";
+        }
+        return false;
+    }
 
-        if (array == NULL)
+    if (array_size <= 0)
+    {
+        if (rank == 0)
         {
-            array = (int *)malloc(array_size * sizeof(int));
+            cout << "Error: Invalid input array size\n";
         }
+        return false;
     }
 
-    gather_sorted_data(recv_buf, recv_size, rank, size, array, all_sizes, displs);
+    // Every process writes its block of the unsorted input (text output only)
+    if (!isBinaryOutput(outputFile) &&
+        !writeDistributedArray(outputFile, local_data.data(), local_data.size(), "Unsorted array: ", false, rank, size, comm))
+    {
+        if (rank == 0)
+        {
+            cout << "Error: Unable to write " << outputFile << "\n";
+        }
+        return false;
+    }
+
+    MPI_Barrier(comm);
+    double start_time = MPI_Wtime();
+
+    if (!sample_sort_buckets(local_data, array_size, rank, size, comm))
+    {
+        return false;
+    }
 
     double end_time = MPI_Wtime();
     MPI_Barrier(comm);
 
+    // Largest bucket relative to the average n/p
+    int recv_size = local_data.size();
+    int max_bucket = 0;
+    MPI_Reduce(&recv_size, &max_bucket, 1, MPI_INT, MPI_MAX, 0, comm);
+
     if (rank == 0)
     {
         double duration = (end_time - start_time) * 1000; 
         cout << "Sample Sort execution time: " << duration << " ms\n";
+        cout << "Sample Sort bucket imbalance (max/avg): " << max_bucket / ((double)array_size / size) << "\n";
+    }
+
+    // Every process writes its sorted bucket at its global offset
+    return writeDistributedArray(outputFile, local_data.data(), recv_size, "Sorted array: ", true, rank, size, comm);
+}
 
-        ofstream outFile(outputFile, ios::app);
-        outFile << "Sorted array: ";
-        for (int i = 0; i < array_size; i++)
+// Sorts inputFile and leaves the result distributed instead of writing it:
+// sorted_data holds elements [global_offset, global_offset + sorted_data.size())
+// of the sorted array, floor(n/p) or ceil(n/p) of them on every process
+bool runSampleSortDistributed(const char *inputFile, vector<int> &sorted_data, long long &global_offset,
+                              int rank, int size, MPI_Comm comm)
+{
+    int array_size = 0;
+    if (!readLocalPartition(inputFile, sorted_data, array_size, rank, size, comm) || array_size <= 0)
+    {
+        if (rank == 0)
         {
-            outFile << array[i] << " ";
+            cout << "Error: Unable to read " << inputFile << "\n";
         }
-        outFile << endl;
-        outFile.close();
-
-        free(array);
-        free(all_sizes);
-        free(displs);
+        return false;
     }
 
-    free(send_counts);
-    free(send_displs);
-    free(local_array);
-    free(local_samples);
-    if (rank == 0)
-        free(samples);
-    free(splitters);
-    free(partition_counts);
-    free(send_buf);
-    free(send_displs_local);
-    free(recv_counts);
-    free(recv_buf);
-    free(recv_displs);
-
+    if (!sample_sort_buckets(sorted_data, array_size, rank, size, comm))
+    {
+        return false;
+    }
+    rebalancePartition(sorted_data, array_size, rank, size, comm);
+    global_offset = blockOffset(array_size, size, rank);
     return true;
 }
 
@@ -1,2 +1,2 @@
-mpic++ -o program source.cpp Prime_Number_Search.cpp Bitonic_Sort.cpp Sample_Sort.cpp Quick_Search.cpp Radix_Sort.cpp;
+mpic++ -o program source.cpp Prime_Number_Search.cpp Bitonic_Sort.cpp Sample_Sort.cpp Quick_Search.cpp Radix_Sort.cpp Parallel_IO.cpp Prime_Counting.cpp Primality_Test.cpp Histogram_Sort.cpp Local_Sort.cpp;
 mpiexec -n 1 ./program
\ No newline at end of file
@@ -9,7 +9,7 @@ mkdir -p $RESULTS_DIR
 
 # Compile the project
 echo "Compiling the project..."
-mpic++ -o program source.cpp Prime_Number_Search.cpp Bitonic_Sort.cpp Sample_Sort.cpp Quick_Search.cpp Radix_Sort.cpp
+mpic++ -o program source.cpp Prime_Number_Search.cpp Bitonic_Sort.cpp Sample_Sort.cpp Quick_Search.cpp Radix_Sort.cpp Parallel_IO.cpp Prime_Counting.cpp Primality_Test.cpp Histogram_Sort.cpp Local_Sort.cpp
 
 # Function to generate sorted array of given size
 generate_sorted_array() {
@@ -130,7 +130,7 @@ run_algorithm() {
     local sys_time=$(format_time "$avg_sys_seconds")
     
     # Copy output to result file
-    echo "Algorithm: $(case $algo_num in 1) echo "Quick Search";; 2) echo "Prime Number Search";; 3) echo "Bitonic Sort";; 4) echo "Radix Sort";; 5) echo "Sample Sort";; esac)" > $result_file
+    echo "Algorithm: $(case $algo_num in 1) echo "Quick Search";; 2) echo "Prime Number Search";; 3) echo "Bitonic Sort";; 4) echo "Radix Sort";; 5) echo "Sample Sort";; 7) echo "Histogram Sort";; esac)" > $result_file
     echo "Input Size: $(wc -w < $input_file)" >> $result_file
     echo "Iterations: $iterations" >> $result_file
     echo "Average User Time: $user_time" >> $result_file
@@ -172,7 +172,7 @@ run_algorithm_with_cores() {
     sys_time=$(grep "sys" $RESULTS_DIR/time_output.txt | awk '{print $2}')
     
     # Copy output to result file
-    echo "Algorithm: $(case $algo_num in 1) echo "Quick Search";; 2) echo "Prime Number Search";; 3) echo "Bitonic Sort";; 4) echo "Radix Sort";; 5) echo "Sample Sort";; esac)" > $result_file
+    echo "Algorithm: $(case $algo_num in 1) echo "Quick Search";; 2) echo "Prime Number Search";; 3) echo "Bitonic Sort";; 4) echo "Radix Sort";; 5) echo "Sample Sort";; 7) echo "Histogram Sort";; esac)" > $result_file
     echo "Cores: $cores" >> $result_file
     echo "Input Size: $(wc -w < $input_file)" >> $result_file
     echo "User Time: $user_time" >> $result_file
@@ -266,7 +266,7 @@ EOF
     local max_user_time=$(echo "scale=3; $avg_user_seconds / $cores" | bc)
     
     # Copy output to result file
-    echo "Algorithm: $(case $algo_num in 1) echo "Quick Search";; 2) echo "Prime Number Search";; 3) echo "Bitonic Sort";; 4) echo "Radix Sort";; 5) echo "Sample Sort";; esac)" > $result_file
+    echo "Algorithm: $(case $algo_num in 1) echo "Quick Search";; 2) echo "Prime Number Search";; 3) echo "Bitonic Sort";; 4) echo "Radix Sort";; 5) echo "Sample Sort";; 7) echo "Histogram Sort";; esac)" > $result_file
     echo "Cores: $cores" >> $result_file
     echo "Input Size: $(wc -w < $input_file)" >> $result_file
     echo "Iterations: $iterations" >> $result_file
@@ -309,7 +309,7 @@ generate_prime_range $PRIME_LARGE "$INPUT_DIR/prime_large.txt"
 generate_prime_range $PRIME_VERY_LARGE "$INPUT_DIR/prime_very_large.txt"  # Generate very large prime range
 
 # Run sorting algorithms on different inputs
-for algo in 3 4 5; do  # 3=Bitonic, 4=Radix, 5=Sample
+for algo in 3 4 5 7; do  # 3=Bitonic, 4=Radix, 5=Sample, 7=Histogram
     echo "Testing algorithm $algo..."
     
     mkdir -p "$RESULTS_DIR/algo_$algo"
@@ -489,6 +489,7 @@ generate_analysis 2 "Prime Number Search" "$RESULTS_DIR/prime_search_analysis.md
 generate_analysis 3 "Bitonic Sort" "$RESULTS_DIR/bitonic_sort_analysis.md"
 generate_analysis 4 "Radix Sort" "$RESULTS_DIR/radix_sort_analysis.md"
 generate_analysis 5 "Sample Sort" "$RESULTS_DIR/sample_sort_analysis.md"
+generate_analysis 7 "Histogram Sort" "$RESULTS_DIR/histogram_sort_analysis.md"
 
 # Add core scaling analysis section
 echo "Starting core scaling analysis with very large inputs..."
@@ -601,7 +602,7 @@ generate_scaling_analysis() {
 echo "Testing core scaling for sorting algorithms..."
 
 # Create directories for core scaling results
-for algo in 1 2 3 4 5; do
+for algo in 1 2 3 4 5 7; do
     mkdir -p "$SCALING_DIR/algo_$algo"
 done
 
@@ -636,12 +637,19 @@ for cores in 1 2 4 8; do
     run_algorithm_with_cores_detailed 5 "$INPUT_DIR/very_large_random.txt" "out.txt" "$SCALING_DIR/algo_5/cores_${cores}_result.txt" $cores
 done
 
+# Run Histogram Sort with different core counts
+echo "Testing Histogram Sort scaling..."
+for cores in 1 2 4 8; do
+    run_algorithm_with_cores_detailed 7 "$INPUT_DIR/very_large_random.txt" "out.txt" "$SCALING_DIR/algo_7/cores_${cores}_result.txt" $cores
+done
+
 # Generate scaling analysis reports
 generate_scaling_analysis 1 "Quick Search" "$SCALING_DIR/quick_search_scaling_analysis.md"
 generate_scaling_analysis 2 "Prime Number Search" "$SCALING_DIR/prime_search_scaling_analysis.md"
 generate_scaling_analysis 3 "Bitonic Sort" "$SCALING_DIR/bitonic_sort_scaling_analysis.md"
 generate_scaling_analysis 4 "Radix Sort" "$SCALING_DIR/radix_sort_scaling_analysis.md"
 generate_scaling_analysis 5 "Sample Sort" "$SCALING_DIR/sample_sort_scaling_analysis.md"
+generate_scaling_analysis 7 "Histogram Sort" "$SCALING_DIR/histogram_sort_scaling_analysis.md"
 
 echo "Core scaling analysis completed! Results are stored in the $SCALING_DIR directory"
 
@@ -5,36 +5,92 @@
 
 using namespace std;
 
-extern void parallelPrimeSearch(int start, int end);
+extern void parallelPrimeSearch(long long start, long long end, int mode);
+extern int primeOutputMode(const string& name);
 extern void bitonicSortParallel(vector<int>& local_data, int local_n, int total_n, int rank, int size, MPI_Comm comm);
 extern bool runBitonicSort(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm);
 extern bool runSampleSort(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm);
 extern bool runQuickSearch(const char* inputFile, const char* outputFile, int target, int rank, int size, MPI_Comm comm);
+extern bool runQuickSearchSession(const char* inputFile, const char* queryFile, const char* outputFile, int layout, int rank, int size, MPI_Comm comm);
+extern int quickSearchLayout(const string& name);
 extern bool runRadixSort(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm); // Add Radix Sort declaration
+extern int readLeadingValues(const char* inputFile, int* values, int count);
+extern bool runPrimalityTest(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm);
+extern bool runHistogramSort(const char* inputFile, const char* outputFile, int rank, int size, MPI_Comm comm);
+extern bool runBitonicSortDistributed(const char* inputFile, vector<int>& sorted_data, long long& global_offset, int rank, int size, MPI_Comm comm);
+extern bool runRadixSortDistributed(const char* inputFile, vector<int>& sorted_data, long long& global_offset, int rank, int size, MPI_Comm comm);
+extern bool runSampleSortDistributed(const char* inputFile, vector<int>& sorted_data, long long& global_offset, int rank, int size, MPI_Comm comm);
+extern bool runHistogramSortDistributed(const char* inputFile, vector<int>& sorted_data, long long& global_offset, int rank, int size, MPI_Comm comm);
+extern bool checkDistributedSort(const char* inputFile, const vector<int>& sorted_data, long long global_offset, int rank, int size, MPI_Comm comm);
 
 
-// Function to read array data for Sorting and searching algorithms
-vector<int> readArrayData(const char *filename)
+// Sorting and searching algorithms read their input in parallel (see Parallel_IO.cpp)
+
+// Function to read range data for Prime Search: "start end [count|list|pi]"
+struct RangeData
+{
+    long long start = 0, end = 0;
+    int mode = 0;
+};
+
+RangeData readRangeData(const char *filename)
 {
+    RangeData data;
     ifstream file(filename);
-    vector<int> data;
-    while (!file.eof()) {
-        int el;
-        file >> el;
-        data.push_back(el);
+    string mode;
+    if (file >> data.start >> data.end)
+    {
+        if (file >> mode)
+            data.mode = primeOutputMode(mode);
+        return data;
     }
-    file.close();
+
+    // Binary dataset format (32-bit bounds only)
+    int range[2] = {0, 0};
+    readLeadingValues(filename, range, 2);
+    data.start = range[0];
+    data.end = range[1];
     return data;
 }
 
-// Function to read range data for Prime Search
-pair<int, int> readRangeData(const char *filename)
+// Distributed Sort Check: runs the run*SortDistributed variant of every sort,
+// which keeps the sorted array in memory instead of writing it, and checks
+// the result with checkDistributedSort. Process 0 writes one line per sort.
+bool runDistributedSortCheck(const char *inputFile, const char *outputFile, int rank, int size, MPI_Comm comm)
 {
-    ifstream file(filename);
-    int start, end;
-    file >> start >> end;
-    file.close();
-    return {start, end};
+    typedef bool (*DistributedSort)(const char *, vector<int> &, long long &, int, int, MPI_Comm);
+    const char *names[4] = {"Bitonic Sort", "Radix Sort", "Sample Sort", "Histogram Sort"};
+    DistributedSort sorts[4] = {runBitonicSortDistributed, runRadixSortDistributed,
+                                runSampleSortDistributed, runHistogramSortDistributed};
+
+    ofstream out;
+    if (rank == 0)
+    {
+        out.open(outputFile);
+        out << "Distributed Sort Check Results:\n";
+    }
+
+    bool all_passed = true;
+    for (int i = 0; i < 4; i++)
+    {
+        vector<int> sorted_data;
+        long long global_offset = 0;
+        MPI_Barrier(comm);
+        double start_time = MPI_Wtime();
+        bool passed = sorts[i](inputFile, sorted_data, global_offset, rank, size, comm);
+        double end_time = MPI_Wtime();
+
+        // Every process returns the same result, so all of them check or none
+        passed = passed && checkDistributedSort(inputFile, sorted_data, global_offset, rank, size, comm);
+        all_passed = all_passed && passed;
+
+        if (rank == 0)
+        {
+            cout << names[i] << ": " << (passed ? "passed" : "FAILED") << " (" << (end_time - start_time) * 1000 << " ms)\n";
+            out << names[i] << ": " << (passed ? "passed" : "FAILED") << "\n";
+        }
+    }
+    return all_passed;
 }
 
 int main(int argc, char **argv)
@@ -62,6 +118,10 @@ int main(int argc, char **argv)
             cout << "3. Bitonic Sort\n";
             cout << "4. Radix Sort\n";
             cout << "5. Sample Sort\n";
+            cout << "6. Primality Test (Miller-Rabin)\n";
+            cout << "7. Histogram Sort\n";
+            cout << "8. Quick Search Session (queries from queries.txt)\n";
+            cout << "9. Distributed Sort Check (sorts kept in memory)\n";
             cout << "Enter choice: ";
             cin >> choice;
         }
@@ -107,18 +167,17 @@ int main(int argc, char **argv)
                 cout << "Running Prime Number Search...\n";
             }
 
-            int start = 0, end = 0;
+            RangeData range;
             if (rank == 0)
             {
-                auto range = readRangeData("in.txt");
-                start = range.first;
-                end = range.second;
+                range = readRangeData("in.txt");
             }
 
-            MPI_Bcast(&start, 1, MPI_INT, 0, MPI_COMM_WORLD);
-            MPI_Bcast(&end, 1, MPI_INT, 0, MPI_COMM_WORLD);
+            MPI_Bcast(&range.start, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+            MPI_Bcast(&range.end, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+            MPI_Bcast(&range.mode, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-            parallelPrimeSearch(start, end);
+            parallelPrimeSearch(range.start, range.end, range.mode);
             break;
         }
         case 3:
@@ -163,6 +222,69 @@ int main(int argc, char **argv)
             break;
         }
 
+        case 6:
+        {
+            if (rank == 0) {
+                cout << "Running Primality Test...\n";
+            }
+
+            // Call the wrapper function that handles everything
+            bool success = runPrimalityTest("in.txt", "out.txt", rank, size, MPI_COMM_WORLD);
+
+            // Set error flag if the test failed
+            is_error = !success;
+            break;
+        }
+
+        case 7:
+        {
+            if (rank == 0) {
+                cout << "Running Histogram Sort...\n";
+            }
+
+            // Call the wrapper function that handles everything
+            bool success = runHistogramSort("in.txt", "out.txt", rank, size, MPI_COMM_WORLD);
+
+            // Set error flag if sorting failed
+            is_error = !success;
+            break;
+        }
+
+        case 8:
+        {
+            int layout = 0;
+            if (rank == 0) {
+                string name;
+                cout << "Enter index layout (sorted, eytzinger, stree): ";
+                cin >> name;
+                layout = quickSearchLayout(name);
+                cout << "Running Quick Search Session...\n";
+            }
+            MPI_Bcast(&layout, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+            // The dataset is indexed once and every query of queries.txt is answered against it
+            bool success = runQuickSearchSession("in.txt", "queries.txt", "out.txt", layout, rank, size, MPI_COMM_WORLD);
+
+            // Set error flag if the session failed
+            is_error = !success;
+            break;
+        }
+
+        case 9:
+        {
+            if (rank == 0) {
+                cout << "Running Distributed Sort Check...\n";
+            }
+
+            // Each sort leaves its result distributed; it is checked for global
+            // order, floor(n/p) or ceil(n/p) elements per process and the input values
+            bool success = runDistributedSortCheck("in.txt", "out.txt", rank, size, MPI_COMM_WORLD);
+
+            // Set error flag if a sort failed its check
+            is_error = !success;
+            break;
+        }
+
         default:
             if (rank == 0)
             {
@@ -172,7 +294,7 @@ int main(int argc, char **argv)
         }
 
 
-        if (rank == 0 && choice > 0 && choice <= 5 && !is_error)
+        if (rank == 0 && choice > 0 && choice <= 9 && !is_error)
         {
             cout << "Algorithm completed successfully!\n";
             cout << "Results written to out.txt\n";